@@ -0,0 +1,107 @@
+#include "BiquadBank.hpp"  // for BiquadBank
+#include <Mahi/Robo.hpp>   // for Butterworth
+#include "Iir.h"           // for Iir::Butterworth
+#include <chrono>          // for std::chrono::steady_clock
+#include <cmath>           // for std::sin, std::fabs
+#include <cstdio>          // for std::printf
+#include <cstdlib>         // for std::atoi
+#include <cstring>         // for std::strcmp
+#include <memory>          // for std::unique_ptr
+#include <vector>          // for std::vector
+
+//=============================================================================
+// FILTER-BENCH
+//=============================================================================
+// Times low-pass filtering of several channels one sample at a time, as the
+// control loop does, with mahi::robo's Butterworth, iir1's Butterworth and a
+// BiquadBank, and checks that the bank agrees with iir1 at every sample.
+
+using namespace mahi::util;
+using namespace mahi::robo;
+
+typedef std::chrono::steady_clock SteadyClock;
+
+/// The order of every filter (iir1 needs it at compile time).
+#define ORDER 4
+/// The number of precomputed input samples, played in a loop.
+#define INPUTS 4096
+
+/// Times fn(n, out) over samples samples. Returns nanoseconds per channel-sample.
+template <typename Fn>
+static double time_filter(int channels, int samples, Fn fn, std::vector<double>& out) {
+    auto start = SteadyClock::now();
+    for (int n = 0; n < samples; ++n)
+        fn(n, out.data());
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - start).count();
+    return (double)ns / ((double)samples * channels);
+}
+
+int main(int argc, char const *argv[]) {
+    double rate    = 1000;
+    double cutoff  = 20;
+    int    samples = 1000000;
+    std::vector<int> channel_counts = {1, 3, 8, 16};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--samples"))
+            samples = std::atoi(argv[i+1]);
+        else {
+            std::printf("usage: pendulum-filter-bench [--samples n]\n");
+            return 1;
+        }
+    }
+    std::printf("Order %d Butterworth low-pass at %.0f Hz of %.0f Hz, %d samples, %d lanes per instruction\n\n",
+                ORDER, cutoff, rate, samples, BIQUAD_WIDTH);
+    std::printf("%8s %16s %16s %16s %12s\n", "Channels", "mahi [ns]", "iir1 [ns]", "BiquadBank [ns]", "Max diff");
+    for (int channels : channel_counts) {
+        std::vector<double> mahi_out(channels), iir_out(channels), bank_out(channels);
+        // a slow sine per channel plus noise near Nyquist for the filters to remove
+        std::vector<double> inputs((std::size_t)INPUTS * channels);
+        for (int n = 0; n < INPUTS; ++n)
+            for (int c = 0; c < channels; ++c)
+                inputs[(std::size_t)n * channels + c] = std::sin(0.01 * n * (c + 1)) + 0.1 * std::sin(0.9 * n);
+        auto input = [&](int c, int n) { return inputs[(std::size_t)(n % INPUTS) * channels + c]; };
+        // mahi::robo, one filter object per channel
+        std::vector<std::unique_ptr<Butterworth>> mahi;
+        for (int c = 0; c < channels; ++c)
+            mahi.emplace_back(new Butterworth(ORDER, hertz(cutoff), hertz(rate)));
+        double t_mahi = time_filter(channels, samples, [&](int n, double* out) {
+            for (int c = 0; c < channels; ++c)
+                out[c] = mahi[c]->update(input(c, n));
+        }, mahi_out);
+        // iir1, one filter object per channel
+        std::vector<Iir::Butterworth::LowPass<ORDER>> iir(channels);
+        for (auto& f : iir)
+            f.setup(rate, cutoff);
+        double t_iir = time_filter(channels, samples, [&](int n, double* out) {
+            for (int c = 0; c < channels; ++c)
+                out[c] = iir[c].filter(input(c, n));
+        }, iir_out);
+        // every channel in one bank
+        BiquadBank bank(channels, (ORDER + 1) / 2);
+        for (int c = 0; c < channels; ++c)
+            bank.set_lane(c, butterworth_lowpass(ORDER, cutoff, rate));
+        double t_bank = time_filter(channels, samples, [&](int n, double* out) {
+            for (int c = 0; c < channels; ++c)
+                out[c] = input(c, n);
+            bank.process(out);
+        }, bank_out);
+        // the same design should give the same output as iir1 to rounding, so
+        // compare fresh filters over the whole run rather than just where it ended
+        std::vector<Iir::Butterworth::LowPass<ORDER>> ref(channels);
+        for (auto& f : ref)
+            f.setup(rate, cutoff);
+        bank.resize(channels, (ORDER + 1) / 2);
+        for (int c = 0; c < channels; ++c)
+            bank.set_lane(c, butterworth_lowpass(ORDER, cutoff, rate));
+        double diff = 0;
+        for (int n = 0; n < samples; ++n) {
+            for (int c = 0; c < channels; ++c)
+                bank_out[c] = input(c, n);
+            bank.process(bank_out.data());
+            for (int c = 0; c < channels; ++c)
+                diff = std::fmax(diff, std::fabs(bank_out[c] - ref[c].filter(input(c, n))));
+        }
+        std::printf("%8d %16.2f %16.2f %16.2f %12.2e\n", channels, t_mahi, t_iir, t_bank, diff);
+    }
+    return 0;
+}
@@ -0,0 +1,368 @@
+#include "IPendulum.hpp"       // for IPendulum
+#include "PendulumRunner.hpp"  // for PendulumRunner
+#include "SimHardware.hpp"     // for SimHardware
+#include "Histogram.hpp"       // for Histogram
+#include "Frame.hpp"           // for FrameView
+#include "ShmRing.hpp"         // for ShmRing
+#include <algorithm>           // for std::min, std::max
+#include <chrono>              // for std::chrono::steady_clock
+#include <cstdio>              // for std::printf
+#include <cstdlib>             // for std::atoi, std::atof
+#include <cstring>             // for std::strcmp
+
+//=============================================================================
+// PENDULUM-BENCH
+//=============================================================================
+// Runs IPendulum against the simulated plant and a headless receiver over
+// loopback TCP/UDP across a sweep of loop rates and plot counts, and reports
+// deadline misses, bytes per tick, packet loss and one-way telemetry latency.
+// The controller can be bound through IPendulum's vtable or at compile time
+// with PendulumRunner, to compare their per-tick cost, and telemetry can be
+// received over UDP or from the shared memory ring, to compare transports.
+
+typedef std::chrono::steady_clock SteadyClock;
+
+/// Nanoseconds since an arbitrary fixed point, shared by both ends of the loopback.
+static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now().time_since_epoch()).count();
+}
+
+/// The number of tick send times remembered for latency measurement.
+#define STAMPS 65536
+
+/// Pendulum that plots a configurable number of channels and stamps each tick.
+/// Base is IPendulum or a PendulumRunner.
+template <class Base>
+class BenchPendulum : public Base {
+public:
+    BenchPendulum() : 
+        Base(std::unique_ptr<SimHardware>(new SimHardware())),
+        stamps(new std::atomic<std::int64_t>[STAMPS])
+    {
+        for (int i = 0; i < MAX_CHANNELS; ++i)
+            channels.push_back(this->channel(fmt::format("Bench {}", i)));
+    }
+
+    double control_encoder(double t, int counts) override {
+        int tick = (int)(t * rate + 0.5);
+        stamps[tick % STAMPS].store(now_ns(), std::memory_order_relaxed);
+        for (int i = 0; i < plots; ++i)
+            channels[i].set(std::sin(2 * PI * (i + 1) * t));
+        return 0.1 * std::sin(2 * PI * t);
+    }
+
+    double control_midori(double t, double midori_volts) override {
+        return 0;
+    }
+
+public:
+    double rate  = 1000; // the loop rate of the current run [Hz]
+    int    plots = 0;    // the number of channels plotted each tick
+    std::vector<PlotChannel> channels; // plot channel handles
+    std::unique_ptr<std::atomic<std::int64_t>[]> stamps; // send time of each tick [ns]
+};
+
+/// The bench pendulum called through IPendulum's vtable.
+class VirtualBench : public BenchPendulum<IPendulum> { };
+
+/// The bench pendulum and simulator bound at compile time.
+class RunnerBench : public BenchPendulum<PendulumRunner<RunnerBench, SimHardware>> { };
+
+/// Results of one benchmark run.
+struct BenchResult {
+    const char* bind = ""; ///< how the controller is bound: "virtual" or "runner"
+    double rate     = 0; ///< the requested loop rate [Hz]
+    int    plots    = 0; ///< the number of plots per tick
+    double actual   = 0; ///< the loop rate reported by the controller [Hz]
+    int    ticks    = 0; ///< the number of controller ticks streamed
+    int    misses   = 0; ///< the number of missed deadlines
+    double wait     = 0; ///< the controller wait ratio
+    int    faults   = 0; ///< the number of page faults the control thread took in its loop
+    int    dropped  = 0; ///< the number of samples dropped by the telemetry queue
+    int    received = 0; ///< the number of samples received
+    int    lost     = 0; ///< the number of streamed samples never received
+    double bytes    = 0; ///< UDP payload bytes per tick
+    double p50      = 0; ///< median one-way telemetry latency [us]
+    double p99      = 0; ///< 99th percentile one-way telemetry latency [us]
+    double max      = 0; ///< worst one-way telemetry latency [us]
+    double tick_p50 = 0; ///< median controller tick execution time, excluding the wait [us]
+    double tick_p99 = 0; ///< 99th percentile controller tick execution time, excluding the wait [us]
+    /// Can the controller keep up at this rate?
+    bool sustainable() const {
+        return ticks > 0 && misses <= ticks / 1000 && lost <= ticks / 1000 && dropped == 0;
+    }
+};
+
+/// Performs the Message::Hello handshake, asking for telemetry on udp_port (0 for shared memory). Returns true if the controller speaks our protocol.
+static bool handshake(TcpSocket& tcp, unsigned short udp_port) {
+    Packet packet;
+    packet << (int)Message::Hello << (int)PROTOCOL_VERSION << udp_port;
+    if (tcp.send(packet) != Socket::Done)
+        return false;
+    packet.clear();
+    if (tcp.receive(packet) != Socket::Done)
+        return false;
+    int msg;
+    Handshake hello;
+    packet >> msg >> hello;
+    return msg == Message::Hello && hello.version == PROTOCOL_VERSION;
+}
+
+/// Sends a Ping and reads back the controller Status, discarding logs.
+static bool ping(TcpSocket& tcp, Status& status) {
+    Packet packet;
+    packet << (int)Message::Ping;
+    if (tcp.send(packet) != Socket::Done)
+        return false;
+    int msg = Message::Logs;
+    while (msg != Message::Update) {
+        packet.clear();
+        if (tcp.receive(packet) != Socket::Done)
+            return false;
+        packet >> msg;
+    }
+    std::uint32_t seq;
+    packet >> seq >> status;
+    return true;
+}
+
+/// Runs the pendulum at one rate and plot count and measures it from the receiving end.
+template <class Pendulum>
+static BenchResult run_bench(Pendulum& pend, const char* bind, double rate, int plots, double duration, const RunOptions& options) {
+    BenchResult result;
+    result.bind  = bind;
+    result.rate  = rate;
+    plots = std::min(std::max(plots, 0), (int)pend.channels.size());
+    result.plots = plots;
+    pend.rate  = rate;
+    pend.plots = plots;
+    // receive telemetry on the GUI's port
+    UdpSocket udp;
+    if (udp.bind(CLIENT_UDP) != Socket::Done) {
+        std::printf("Failed to bind UDP port %d.\n", CLIENT_UDP);
+        return result;
+    }
+    // start the controller, which blocks in run() until we shut it down
+    std::thread server([&]() { pend.run(hertz(rate), options); });
+    TcpSocket tcp;
+    Clock connect_clock;
+    while (tcp.connect(SERVER_IP, SERVER_TCP, seconds(0.1)) != Socket::Done) {
+        if (connect_clock.get_elapsed_time() > seconds(5)) {
+            std::printf("Failed to connect to the controller.\n");
+            std::exit(1);
+        }
+        sleep(milliseconds(10));
+    }
+    // the controller creates its ring before it accepts connections
+    ShmRing ring;
+    if (options.shm && !ring.open(shm_name(SERVER_TCP))) {
+        std::printf("Failed to open the controller's shared memory.\n");
+        std::exit(1);
+    }
+    if (!handshake(tcp, options.shm ? 0 : CLIENT_UDP)) {
+        std::printf("The controller speaks a different protocol version.\n");
+        std::exit(1);
+    }
+    // receive until the stop sample arrives (or the controller has stopped and gone quiet)
+    Histogram latency;
+    std::int64_t bytes = 0;
+    int last_tick = -1;
+    std::atomic_bool stopped(false);
+    std::thread receiver([&]() {
+        std::unique_ptr<unsigned char[]> buffer(new unsigned char[UdpSocket::MaxDatagramSize]);
+        std::size_t received;
+        FrameView frame;
+        IpAddress address;
+        unsigned short port;
+        // returns false once the stop sample arrives
+        auto handle = [&](std::int64_t arrival) {
+            bytes += received;
+            if (frame.parse(buffer.get(), received) != FrameView::Ok)
+                return true;
+            for (int s = 0; s < frame.samples(); ++s) {
+                int tick = frame.sample(s).tick();
+                if (tick == -1)
+                    return false;
+                std::int64_t sent = pend.stamps[tick % STAMPS].load(std::memory_order_relaxed);
+                latency.record(arrival > sent ? (std::uint64_t)(arrival - sent) : 0);
+                last_tick = std::max(last_tick, tick);
+                result.received++;
+            }
+            return true;
+        };
+        if (ring.is_open()) {
+            // poll the ring as fast as we can, to measure the transport rather than a sleep
+            std::int64_t skipped = 0;
+            while (true) {
+                if (ring.read(buffer.get(), received, skipped)) {
+                    if (!handle(now_ns()))
+                        return;
+                }
+                else if (stopped)
+                    break;
+                else
+                    std::this_thread::yield();
+            }
+        }
+        SocketSelector selector;
+        selector.add(udp);
+        while (!ring.is_open()) {
+            if (!selector.wait(milliseconds(200))) {
+                if (stopped)
+                    break;
+                continue;
+            }
+            if (udp.receive(buffer.get(), UdpSocket::MaxDatagramSize, received, address, port) != Socket::Done)
+                break;
+            if (!handle(now_ns()))
+                return;
+        }
+    });
+    // keep the controller's logs drained while it runs, then grab its final status
+    Status status;
+    Clock clock;
+    while (clock.get_elapsed_time() < seconds(duration)) {
+        ping(tcp, status);
+        sleep(milliseconds(100));
+    }
+    ping(tcp, status);
+    Packet packet;
+    packet << (int)Message::Shutdown;
+    tcp.send(packet);
+    // disconnect first so the controller can re-listen on its port for the next run
+    tcp.disconnect();
+    server.join();
+    stopped = true;
+    receiver.join();
+    udp.unbind();
+    int decimation  = std::max(options.decimation, 1);
+    result.actual   = status.frequency;
+    result.ticks    = last_tick + 1;
+    result.misses   = status.misses;
+    result.wait     = status.wait;
+    result.faults   = status.faults;
+    result.dropped  = status.dropped;
+    result.lost     = std::max((last_tick / decimation + 1) - result.received, 0);
+    result.bytes    = result.ticks > 0 ? (double)bytes / result.ticks : 0;
+    result.p50      = latency.percentile(0.50) / 1000.0;
+    result.p99      = latency.percentile(0.99) / 1000.0;
+    result.max      = latency.max() / 1000.0;
+    result.tick_p50 = status.timing[PhaseTick].p50;
+    result.tick_p99 = status.timing[PhaseTick].p99;
+    return result;
+}
+
+/// Parses a comma separated list of numbers.
+static std::vector<double> parse_list(const char* arg) {
+    std::vector<double> values;
+    std::string str(arg);
+    std::size_t start = 0;
+    while (start < str.size()) {
+        std::size_t end = str.find(',', start);
+        if (end == std::string::npos)
+            end = str.size();
+        values.push_back(std::atof(str.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+    return values;
+}
+
+int main(int argc, char const *argv[]) {
+    std::vector<double> rates = {500, 1000, 2000, 4000, 8000};
+    std::vector<double> plots = {0, 4, 16};
+    double duration = 3;
+    std::string bind = "virtual";
+    RunOptions options;
+    // stream every tick unless asked otherwise, to measure the full telemetry load
+    options.telemetry_rate = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--rates"))
+            rates = parse_list(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--plots"))
+            plots = parse_list(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--duration"))
+            duration = std::atof(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--batch"))
+            options.batch = std::atoi(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--decimation"))
+            options.decimation = std::atoi(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--telemetry-rate"))
+            options.telemetry_rate = std::atof(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--priority"))
+            options.priority = std::atoi(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--ctrl-cpu"))
+            options.ctrl_cpu = std::atoi(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--net-cpu"))
+            options.net_cpu = std::atoi(argv[i+1]);
+        else if (!std::strcmp(argv[i], "--mlock"))
+            options.mlock = std::atoi(argv[i+1]) != 0;
+        else if (!std::strcmp(argv[i], "--prefault"))
+            options.prefault = std::atoi(argv[i+1]) != 0;
+        else if (!std::strcmp(argv[i], "--bind"))
+            bind = argv[i+1];
+        else if (!std::strcmp(argv[i], "--transport"))
+            options.shm = !std::strcmp(argv[i+1], "shm");
+        else {
+            std::printf("usage: pendulum-bench [--rates 500,1000,...] [--plots 0,4,16] [--duration s] [--batch n] [--decimation n]\n"
+                        "                      [--telemetry-rate hz]\n"
+                        "                      [--priority 1-99] [--ctrl-cpu c] [--net-cpu c] [--mlock 0|1] [--prefault 0|1]\n"
+                        "                      [--bind virtual|runner|both] [--transport udp|shm]\n");
+            return 1;
+        }
+    }
+
+    std::vector<const char*> binds;
+    if (bind == "virtual" || bind == "both")
+        binds.push_back("virtual");
+    if (bind == "runner" || bind == "both")
+        binds.push_back("runner");
+    if (binds.empty()) {
+        std::printf("Unknown binding %s.\n", bind.c_str());
+        return 1;
+    }
+
+    VirtualBench virtual_pend;
+    RunnerBench  runner_pend;
+    if (MahiLogger)
+        MahiLogger->set_max_severity(Warning);
+
+    std::printf("%8s %8s %6s %9s %8s %7s %7s %7s %8s %8s %8s %9s %9s %9s %9s %9s\n",
+                "Bind", "Rate", "Plots", "Actual", "Ticks", "Misses", "Wait", "Faults", "Dropped", "Lost", "B/tick",
+                "Lat p50", "Lat p99", "Lat max", "Tick p50", "Tick p99");
+    std::vector<BenchResult> results;
+    for (double p : plots) {
+        for (double r : rates) {
+            // alternate bindings at each point so drift on the host affects both alike
+            for (const char* b : binds) {
+                auto res = !std::strcmp(b, "runner") ? run_bench(runner_pend, b, r, (int)p, duration, options)
+                                                     : run_bench(virtual_pend, b, r, (int)p, duration, options);
+                results.push_back(res);
+                std::printf("%8s %8.0f %6d %9.1f %8d %7d %6.1f%% %7d %8d %8d %8.1f %8.1fus %8.1fus %8.1fus %7.2fus %7.2fus %s\n",
+                            res.bind, res.rate, res.plots, res.actual, res.ticks, res.misses, res.wait * 100, res.faults, res.dropped,
+                            res.lost, res.bytes, res.p50, res.p99, res.max, res.tick_p50, res.tick_p99, res.sustainable() ? "" : "*");
+            }
+        }
+    }
+    std::printf("\n* not sustainable (misses or loss above 0.1%%, or dropped samples)\n\n");
+    // report the fastest sustainable rate for each plot count, and the typical tick cost of each binding
+    for (const char* b : binds) {
+        for (double p : plots) {
+            double best = 0;
+            for (auto& res : results) {
+                if (res.bind == b && res.plots == (int)p && res.sustainable())
+                    best = std::max(best, res.rate);
+            }
+            std::printf("Max sustainable loop rate with %d plot(s) (%s): %.0f Hz\n", (int)p, b, best);
+        }
+        double tick = 0;
+        int n = 0;
+        for (auto& res : results) {
+            if (res.bind == b) {
+                tick += res.tick_p50;
+                n++;
+            }
+        }
+        std::printf("Mean tick p50 (%s): %.2f us\n", b, n ? tick / n : 0);
+    }
+    return 0;
+}
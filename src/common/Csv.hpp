@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>  // for std::min
+#include <charconv>   // for std::to_chars
+#include <cmath>      // for std::isnan
+#include <cstdio>     // for std::FILE, std::fwrite
+#include <string>     // for std::string
+#include <thread>     // for std::thread
+#include <vector>     // for std::vector
+
+/// The number of rows each thread formats at a time.
+#define CSV_BLOCK_ROWS 16384
+/// Room for one formatted number and its separator.
+#define CSV_NUMBER_CHARS 32
+
+/// Formats a number into p with the shortest representation that reads back
+/// exactly, followed by sep. NaN (a channel that wasn't plotted) is written as 0.
+inline char* csv_number(char* p, double value, char sep) {
+    if (std::isnan(value))
+        value = 0;
+#if defined(__cpp_lib_to_chars) || defined(_MSC_VER)
+    p = std::to_chars(p, p + CSV_NUMBER_CHARS - 1, value).ptr;
+#else
+    p += std::snprintf(p, CSV_NUMBER_CHARS - 1, "%.17g", value);
+#endif
+    *p++ = sep;
+    return p;
+}
+
+/// Appends rows [first, last) of column-major data to out, one line per row.
+inline void csv_format(std::string& out, const std::vector<const double*>& columns, std::size_t first, std::size_t last) {
+    std::size_t width = columns.size() * CSV_NUMBER_CHARS + 1;
+    std::size_t start = out.size();
+    out.resize(start + (last - first) * width);
+    char* p = &out[start];
+    for (std::size_t r = first; r < last; ++r) {
+        for (std::size_t c = 0; c < columns.size(); ++c)
+            p = csv_number(p, columns[c][r], ',');
+        *p++ = '\n';
+    }
+    out.resize(p - out.data());
+}
+
+/// Writes rows of column-major data to file as CSV. Blocks of rows are
+/// formatted in parallel on every core and written in order with one large
+/// write per block. Returns false if a write failed.
+inline bool csv_write(std::FILE* file, const std::vector<const double*>& columns, std::size_t rows, unsigned int threads = 0) {
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::string> blocks(threads);
+    std::vector<std::thread> workers;
+    bool ok = true;
+    for (std::size_t round = 0; round < rows; round += threads * (std::size_t)CSV_BLOCK_ROWS) {
+        // block 0 is formatted here while the rest are formatted by workers
+        auto format = [&](unsigned int b) {
+            std::size_t first = std::min(rows, round + b * (std::size_t)CSV_BLOCK_ROWS);
+            std::size_t last  = std::min(rows, first + CSV_BLOCK_ROWS);
+            blocks[b].clear();
+            csv_format(blocks[b], columns, first, last);
+        };
+        workers.clear();
+        for (unsigned int b = 1; b < threads; ++b)
+            workers.emplace_back(format, b);
+        format(0);
+        for (auto& w : workers)
+            w.join();
+        for (auto& block : blocks)
+            ok &= std::fwrite(block.data(), 1, block.size(), file) == block.size();
+    }
+    return ok;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "common.hpp"  // for State
+#include <algorithm>   // for std::max
+#include <cstdint>     // for std::uint32_t etc.
+#include <cstring>     // for std::memcpy
+#include <memory>      // for std::unique_ptr
+#include <utility>     // for std::swap
+
+//=============================================================================
+// TELEMETRY FRAME FORMAT
+//=============================================================================
+// Every UDP datagram is one frame: a fixed header followed by fixed-stride
+// samples. All fields are little-endian and packed at the offsets below, so a
+// receiver can validate a frame and read it in place.
+//
+// Header (FRAME_HEADER_BYTES):
+//   0  u32  magic       FRAME_MAGIC
+//   4  u16  version     PROTOCOL_VERSION
+//   6  u16  decimation  controller ticks between consecutive samples
+//   8  u32  sequence    frame number, incremented for every datagram sent
+//  12  u16  channels    plot channel values per sample
+//  14  u16  samples     samples in this frame
+//  16  u32  checksum    CRC-32 of the whole frame with this field zeroed
+//  20  u32  reserved    zero
+//
+// Sample (FRAME_STATE_BYTES + 8 * channels):
+//   0  i32  tick        controller tick (-1 marks the final sample)
+//   4  i32  encoder     encoder counts
+//   8  f64  sense       amplifier sense voltage
+//  16  f64  command     amplifier command voltage
+//  24  f64  midori      Midori pot voltage
+//  32  u8   enable      amplifier enable state
+//  33  u8   reserved[7] zero
+//  40  f64  values[channels] plot channel values (NaN if not plotted that tick)
+//
+// The controller time is not sent: it is tick / loop rate, and the loop rate
+// is exchanged in the Message::Hello handshake when the GUI connects.
+
+#define FRAME_MAGIC        0x38383450u // "P488" as little-endian bytes (see PROTOCOL_VERSION in common.hpp)
+#define FRAME_HEADER_BYTES 24
+#define FRAME_STATE_BYTES  40
+
+/// Writes a value to a little-endian byte buffer.
+template <typename T>
+inline void wire_put(unsigned char* p, T value) {
+    std::memcpy(p, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (std::size_t i = 0; i < sizeof(T) / 2; ++i)
+        std::swap(p[i], p[sizeof(T) - 1 - i]);
+#endif
+}
+
+/// Reads a value from a little-endian byte buffer.
+template <typename T>
+inline T wire_get(const unsigned char* p) {
+    T value;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    unsigned char bytes[sizeof(T)];
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        bytes[i] = p[sizeof(T) - 1 - i];
+    std::memcpy(&value, bytes, sizeof(T));
+#else
+    std::memcpy(&value, p, sizeof(T));
+#endif
+    return value;
+}
+
+/// Computes the CRC-32 (IEEE 802.3) of a byte buffer.
+inline std::uint32_t frame_crc32(const unsigned char* data, std::size_t size, std::uint32_t crc = 0) {
+    struct Table {
+        std::uint32_t entries[256];
+        Table() {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+        }
+    };
+    static const Table table;
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/// Returns the size of one sample in a frame with the given number of channels.
+inline std::size_t frame_stride(int channels) {
+    return FRAME_STATE_BYTES + 8 * (std::size_t)channels;
+}
+
+/// Builds telemetry frames in a preallocated buffer.
+class FrameWriter {
+public:
+    /// Constructor. Frames are limited to max_bytes, but always fit at least one sample.
+    FrameWriter(std::size_t max_bytes, int max_channels) :
+        m_max_bytes(max_bytes),
+        m_buffer(new unsigned char[std::max(max_bytes, FRAME_HEADER_BYTES + frame_stride(max_channels))]),
+        m_size(0), m_channels(0), m_samples(0), m_sequence(0)
+    { }
+
+    /// Starts a new frame.
+    void begin(int channels, int decimation) {
+        std::memset(m_buffer.get(), 0, FRAME_HEADER_BYTES);
+        wire_put<std::uint32_t>(m_buffer.get() + 0, FRAME_MAGIC);
+        wire_put<std::uint16_t>(m_buffer.get() + 4, PROTOCOL_VERSION);
+        wire_put<std::uint16_t>(m_buffer.get() + 6, (std::uint16_t)decimation);
+        wire_put<std::uint32_t>(m_buffer.get() + 8, m_sequence);
+        wire_put<std::uint16_t>(m_buffer.get() + 12, (std::uint16_t)channels);
+        m_size     = FRAME_HEADER_BYTES;
+        m_channels = channels;
+        m_samples  = 0;
+    }
+
+    /// Returns true if another sample fits in the current frame.
+    bool fits() const {
+        return m_samples == 0 || m_size + frame_stride(m_channels) <= m_max_bytes;
+    }
+
+    /// Appends a sample to the current frame. Check fits() first.
+    void append(const State& state, const double* values) {
+        unsigned char* p = m_buffer.get() + m_size;
+        wire_put<std::int32_t>(p + 0, state.tick);
+        wire_put<std::int32_t>(p + 4, state.encoder);
+        wire_put<double>(p + 8, state.sense);
+        wire_put<double>(p + 16, state.command);
+        wire_put<double>(p + 24, state.midori);
+        std::memset(p + 32, 0, 8);
+        p[32] = state.enable ? 1 : 0;
+        for (int i = 0; i < m_channels; ++i)
+            wire_put<double>(p + FRAME_STATE_BYTES + 8 * i, values[i]);
+        m_size += frame_stride(m_channels);
+        m_samples++;
+    }
+
+    /// Completes the current frame so it can be sent.
+    void finish() {
+        wire_put<std::uint16_t>(m_buffer.get() + 14, (std::uint16_t)m_samples);
+        wire_put<std::uint32_t>(m_buffer.get() + 16, frame_crc32(m_buffer.get(), m_size));
+        m_sequence++;
+    }
+
+    /// The channels per sample in the current frame.
+    int channels() const { return m_channels; }
+    /// The samples in the current frame.
+    int samples() const { return m_samples; }
+    /// The frame bytes.
+    const unsigned char* data() const { return m_buffer.get(); }
+    /// The frame size in bytes.
+    std::size_t size() const { return m_size; }
+
+private:
+    std::size_t                      m_max_bytes; // frame size limit
+    std::unique_ptr<unsigned char[]> m_buffer;    // frame bytes
+    std::size_t                      m_size;      // bytes written to the current frame
+    int                              m_channels;  // channels per sample in the current frame
+    int                              m_samples;   // samples in the current frame
+    std::uint32_t                    m_sequence;  // sequence number of the current frame
+};
+
+/// Read-only view of one sample in a telemetry frame.
+class SampleRef {
+public:
+    SampleRef(const unsigned char* p) : m_p(p) { }
+    int    tick()    const { return wire_get<std::int32_t>(m_p + 0); }
+    int    encoder() const { return wire_get<std::int32_t>(m_p + 4); }
+    double sense()   const { return wire_get<double>(m_p + 8); }
+    double command() const { return wire_get<double>(m_p + 16); }
+    double midori()  const { return wire_get<double>(m_p + 24); }
+    char   enable()  const { return (char)m_p[32]; }
+    /// The value of plot channel i (NaN if it was not plotted this tick).
+    double value(int i) const { return wire_get<double>(m_p + FRAME_STATE_BYTES + 8 * i); }
+private:
+    const unsigned char* m_p;
+};
+
+/// Validates a received telemetry frame and reads it in place.
+class FrameView {
+public:
+    /// Results of parsing a frame.
+    enum Result {
+        Ok          = 0, ///< the frame is valid
+        Truncated   = 1, ///< the frame is smaller than its header says
+        BadMagic    = 2, ///< the datagram is not a telemetry frame
+        BadVersion  = 3, ///< the frame was sent with a different protocol version
+        BadChecksum = 4  ///< the frame was corrupted
+    };
+
+    FrameView() : m_data(nullptr), m_size(0) { }
+
+    /// Validates the frame in data. The buffer must outlive the view.
+    Result parse(const unsigned char* data, std::size_t size) {
+        m_data = data;
+        m_size = 0;
+        if (size < FRAME_HEADER_BYTES)
+            return Truncated;
+        if (wire_get<std::uint32_t>(data + 0) != FRAME_MAGIC)
+            return BadMagic;
+        if (wire_get<std::uint16_t>(data + 4) != PROTOCOL_VERSION)
+            return BadVersion;
+        std::size_t expected = FRAME_HEADER_BYTES + frame_stride(wire_get<std::uint16_t>(data + 12)) * wire_get<std::uint16_t>(data + 14);
+        if (size < expected)
+            return Truncated;
+        // checksum everything but the checksum field itself
+        static const unsigned char zeros[4] = {0, 0, 0, 0};
+        std::uint32_t crc = frame_crc32(data, 16);
+        crc = frame_crc32(zeros, 4, crc);
+        crc = frame_crc32(data + 20, expected - 20, crc);
+        if (crc != wire_get<std::uint32_t>(data + 16))
+            return BadChecksum;
+        m_size = expected;
+        return Ok;
+    }
+
+    int decimation()  const { return wire_get<std::uint16_t>(m_data + 6); }
+    std::uint32_t sequence() const { return wire_get<std::uint32_t>(m_data + 8); }
+    int channels()    const { return wire_get<std::uint16_t>(m_data + 12); }
+    int samples()     const { return wire_get<std::uint16_t>(m_data + 14); }
+    /// The frame size in bytes.
+    std::size_t size() const { return m_size; }
+    /// Sample i of the frame.
+    SampleRef sample(int i) const { return SampleRef(m_data + FRAME_HEADER_BYTES + frame_stride(channels()) * i); }
+
+private:
+    const unsigned char* m_data; // frame bytes
+    std::size_t          m_size; // validated frame size
+};
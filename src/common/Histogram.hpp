@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>  // for std::uint64_t
+#include <cstring>  // for std::memset
+
+/// Fixed-bucket log-linear histogram of non-negative integer samples (e.g.
+/// nanoseconds). Values below 32 get their own bucket and every power of two
+/// above that is split into 16 buckets, so percentiles are within ~6% while 
+/// record() costs a handful of integer operations and never allocates.
+class Histogram {
+public:
+    /// Constructor.
+    Histogram() { clear(); }
+
+    /// Adds a sample to the histogram.
+    void record(std::uint64_t value) {
+        m_buckets[bucket(value)]++;
+        if (m_count == 0 || value < m_min)
+            m_min = value;
+        if (value > m_max)
+            m_max = value;
+        m_count++;
+    }
+
+    /// Removes all samples.
+    void clear() {
+        std::memset(m_buckets, 0, sizeof(m_buckets));
+        m_count = m_min = m_max = 0;
+    }
+
+    /// The number of recorded samples.
+    std::uint64_t count() const { return m_count; }
+    /// The smallest recorded sample.
+    std::uint64_t min() const { return m_min; }
+    /// The largest recorded sample.
+    std::uint64_t max() const { return m_max; }
+
+    /// Returns the approximate value below which fraction p [0...1] of samples fall.
+    double percentile(double p) const {
+        if (m_count == 0)
+            return 0;
+        std::uint64_t target = (std::uint64_t)(p * (double)m_count + 0.5);
+        if (target < 1)
+            target = 1;
+        std::uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += m_buckets[b];
+            if (seen >= target) {
+                double mid = midpoint(b);
+                return mid < (double)m_min ? (double)m_min : mid > (double)m_max ? (double)m_max : mid;
+            }
+        }
+        return (double)m_max;
+    }
+
+private:
+    static constexpr int LINEAR  = 32; // values below this get their own bucket
+    static constexpr int SUB     = 16; // buckets per power of two above LINEAR
+    static constexpr int MAX_EXP = 40; // values at or above 2^MAX_EXP land in the last bucket
+    static constexpr int BUCKETS = LINEAR + (MAX_EXP - 5) * SUB;
+
+    /// Maps a value to its bucket index.
+    static int bucket(std::uint64_t value) {
+        if (value < LINEAR)
+            return (int)value;
+        int e = 5;
+        while (e < MAX_EXP && (value >> (e + 1)) != 0)
+            e++;
+        if (e == MAX_EXP)
+            return BUCKETS - 1;
+        int sub = (int)((value >> (e - 4)) & (SUB - 1));
+        return LINEAR + (e - 5) * SUB + sub;
+    }
+
+    /// Returns the value at the middle of a bucket.
+    static double midpoint(int b) {
+        if (b < LINEAR)
+            return b;
+        int e   = 5 + (b - LINEAR) / SUB;
+        int sub = (b - LINEAR) % SUB;
+        double width = (double)(1ull << (e - 4));
+        return (SUB + sub) * width + 0.5 * width;
+    }
+
+    std::uint64_t m_buckets[BUCKETS]; // sample counts per bucket
+    std::uint64_t m_count;            // total number of samples
+    std::uint64_t m_min;              // smallest sample
+    std::uint64_t m_max;              // largest sample
+};
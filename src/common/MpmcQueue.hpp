@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>   // for std::atomic
+#include <cstddef>  // for std::size_t
+#include <memory>   // for std::unique_ptr
+
+/// Bounded lock-free multi-producer/multi-consumer queue (Dmitry Vyukov's 
+/// design). Every cell carries a sequence number that tells producers and 
+/// consumers whose turn it is, so pushes and pops never block or allocate.
+template <typename T>
+class MpmcQueue {
+public:
+    /// Constructor. The capacity is rounded up to a power of two.
+    explicit MpmcQueue(std::size_t capacity) :
+        m_capacity(round_up(capacity)),
+        m_mask(m_capacity - 1),
+        m_cells(new Cell[m_capacity]),
+        m_head(0),
+        m_tail(0)
+    {
+        for (std::size_t i = 0; i < m_capacity; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /// Pushes a copy of value. Returns false if the queue is full.
+    bool try_push(const T& value) {
+        std::size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+            if (dif == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Pops the oldest value into value. Returns false if the queue is empty.
+    bool try_pop(T& value) {
+        std::size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t dif = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+            if (dif == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.data;
+                    cell.seq.store(pos + m_capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (dif < 0)
+                return false;
+            else
+                pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    /// The number of values the queue can hold.
+    std::size_t capacity() const { return m_capacity; }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
+
+    static std::size_t round_up(std::size_t n) {
+        std::size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    const std::size_t        m_capacity; // number of cells (power of two)
+    const std::size_t        m_mask;     // m_capacity - 1
+    std::unique_ptr<Cell[]>  m_cells;    // the cells
+    alignas(64) std::atomic<std::size_t> m_head; // next cell to pop
+    alignas(64) std::atomic<std::size_t> m_tail; // next cell to push
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "Frame.hpp"  // for wire_put, wire_get, FrameView
+#include <cstdio>     // for std::FILE
+#include <string>     // for std::string
+#include <vector>     // for std::vector
+
+//=============================================================================
+// SESSION RECORDING FORMAT
+//=============================================================================
+// A recording is a file header followed by self-delimiting chunks, so it can
+// be read sequentially even if the recorder never finished. A complete file
+// ends with an Index chunk and a trailer pointing at it. All fields are
+// little-endian, like telemetry frames.
+//
+// File header (REC_HEADER_BYTES):
+//   0  u32  magic       REC_MAGIC
+//   4  u16  version     REC_VERSION
+//   6  u16  protocol    PROTOCOL_VERSION of the recorded frames
+//   8  f64  loop_rate   controller loop rate [Hz]
+//  16  u32  decimation  controller ticks between streamed samples
+//  20  u32  reserved    zero
+//  24  i64  start       recording start time [ms since the Unix epoch]
+//
+// Chunk header (REC_CHUNK_BYTES), followed by size bytes of payload:
+//   0  u32  type        ChunkFrames, ChunkLabels or ChunkIndex
+//   4  u32  count       frames, labels or index entries in the payload
+//   8  u32  channels    the most plot channels in any frame of the chunk
+//  12  i32  first_tick  first tick in the chunk (frames only)
+//  16  u64  size        payload bytes
+//
+// Payloads:
+//   ChunkFrames  count x (u32 frame bytes, then the telemetry frame as received)
+//   ChunkLabels  count x (u32 channel ID, u16 length, then the label bytes)
+//   ChunkIndex   count x (u64 file offset of a frames chunk, i32 first tick, i32 last tick)
+//
+// Trailer (REC_TRAILER_BYTES): u64 file offset of the index chunk, u32 REC_TRAILER, u32 zero.
+
+#define REC_MAGIC         0x43523450u // "P4RC" as little-endian bytes
+#define REC_TRAILER       0x58443450u // "P4DX" as little-endian bytes
+#define REC_VERSION       1
+#define REC_HEADER_BYTES  32
+#define REC_CHUNK_BYTES   24
+#define REC_INDEX_BYTES   16
+#define REC_TRAILER_BYTES 16
+
+/// Types of chunks in a recording.
+enum ChunkType {
+    ChunkFrames = 1,
+    ChunkLabels = 2,
+    ChunkIndex  = 3
+};
+
+/// Recording file header.
+struct RecordingHeader {
+    int           version    = REC_VERSION;      ///< the recording format version
+    int           protocol   = PROTOCOL_VERSION; ///< the protocol version of the recorded frames
+    double        loop_rate  = 0;                ///< the controller loop rate [Hz]
+    int           decimation = 1;                ///< controller ticks between streamed samples
+    std::int64_t  start      = 0;                ///< recording start time [ms since the Unix epoch]
+};
+
+/// Header of one chunk in a recording.
+struct ChunkHeader {
+    int           type       = ChunkFrames; ///< the ChunkType
+    int           count      = 0;           ///< frames, labels or index entries in the payload
+    int           channels   = 0;           ///< the most plot channels in any frame of the chunk
+    int           first_tick = 0;           ///< first tick in the chunk (frames only)
+    std::uint64_t size       = 0;           ///< payload bytes
+};
+
+/// Index entry of one frames chunk.
+struct IndexEntry {
+    std::uint64_t offset     = 0; ///< file offset of the chunk header
+    int           first_tick = 0; ///< first tick in the chunk
+    int           last_tick  = 0; ///< last tick in the chunk
+};
+
+/// Encodes a RecordingHeader.
+inline void rec_put(unsigned char* p, const RecordingHeader& h) {
+    wire_put<std::uint32_t>(p + 0, REC_MAGIC);
+    wire_put<std::uint16_t>(p + 4, (std::uint16_t)h.version);
+    wire_put<std::uint16_t>(p + 6, (std::uint16_t)h.protocol);
+    wire_put<double>(p + 8, h.loop_rate);
+    wire_put<std::uint32_t>(p + 16, (std::uint32_t)h.decimation);
+    wire_put<std::uint32_t>(p + 20, 0);
+    wire_put<std::int64_t>(p + 24, h.start);
+}
+
+/// Encodes a ChunkHeader.
+inline void rec_put(unsigned char* p, const ChunkHeader& h) {
+    wire_put<std::uint32_t>(p + 0, (std::uint32_t)h.type);
+    wire_put<std::uint32_t>(p + 4, (std::uint32_t)h.count);
+    wire_put<std::uint32_t>(p + 8, (std::uint32_t)h.channels);
+    wire_put<std::int32_t>(p + 12, h.first_tick);
+    wire_put<std::uint64_t>(p + 16, h.size);
+}
+
+/// Encodes an IndexEntry.
+inline void rec_put(unsigned char* p, const IndexEntry& e) {
+    wire_put<std::uint64_t>(p + 0, e.offset);
+    wire_put<std::int32_t>(p + 8, e.first_tick);
+    wire_put<std::int32_t>(p + 12, e.last_tick);
+}
+
+/// Seeks to an absolute offset in a file larger than 2 GB.
+inline bool rec_seek(std::FILE* file, std::uint64_t offset, int origin = SEEK_SET) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, origin) == 0;
+#else
+    return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+/// Reads a recording chunk by chunk.
+class RecordingReader {
+public:
+    RecordingReader() : m_file(nullptr), m_offset(0), m_size(0) { }
+    ~RecordingReader() { close(); }
+
+    /// Opens a recording and reads its header and index (if it was finished).
+    bool open(const std::string& path) {
+        close();
+        m_file = std::fopen(path.c_str(), "rb");
+        if (!m_file)
+            return false;
+        unsigned char b[REC_HEADER_BYTES];
+        if (std::fread(b, 1, REC_HEADER_BYTES, m_file) != REC_HEADER_BYTES || wire_get<std::uint32_t>(b) != REC_MAGIC) {
+            close();
+            return false;
+        }
+        m_header.version    = wire_get<std::uint16_t>(b + 4);
+        m_header.protocol   = wire_get<std::uint16_t>(b + 6);
+        m_header.loop_rate  = wire_get<double>(b + 8);
+        m_header.decimation = (int)wire_get<std::uint32_t>(b + 16);
+        m_header.start      = wire_get<std::int64_t>(b + 24);
+        rec_seek(m_file, 0, SEEK_END);
+#ifdef _WIN32
+        m_size = (std::uint64_t)_ftelli64(m_file);
+#else
+        m_size = (std::uint64_t)ftello(m_file);
+#endif
+        read_index();
+        return rewind();
+    }
+
+    /// Closes the recording.
+    void close() {
+        if (m_file)
+            std::fclose(m_file);
+        m_file = nullptr;
+        m_index.clear();
+    }
+
+    /// Returns to the first chunk.
+    bool rewind() {
+        m_offset = REC_HEADER_BYTES;
+        return rec_seek(m_file, m_offset);
+    }
+
+    /// Moves to the chunk at a file offset (e.g. from the index).
+    bool seek(std::uint64_t offset) {
+        m_offset = offset;
+        return rec_seek(m_file, m_offset);
+    }
+
+    /// Reads the next chunk header. Returns false at the end of the chunks.
+    bool next(ChunkHeader& chunk) {
+        unsigned char b[REC_CHUNK_BYTES];
+        if (m_offset + REC_CHUNK_BYTES > m_size || std::fread(b, 1, REC_CHUNK_BYTES, m_file) != REC_CHUNK_BYTES)
+            return false;
+        chunk.type       = (int)wire_get<std::uint32_t>(b + 0);
+        chunk.count      = (int)wire_get<std::uint32_t>(b + 4);
+        chunk.channels   = (int)wire_get<std::uint32_t>(b + 8);
+        chunk.first_tick = wire_get<std::int32_t>(b + 12);
+        chunk.size       = wire_get<std::uint64_t>(b + 16);
+        if (chunk.type < ChunkFrames || chunk.type > ChunkIndex)
+            return false;
+        // salvage the frames that made it to disk from a chunk cut short by a crash
+        if (m_offset + REC_CHUNK_BYTES + chunk.size > m_size) {
+            if (chunk.type != ChunkFrames)
+                return false;
+            chunk.size = m_size - m_offset - REC_CHUNK_BYTES;
+        }
+        m_offset += REC_CHUNK_BYTES + chunk.size;
+        return true;
+    }
+
+    /// Reads the payload of the chunk just returned by next().
+    bool read(const ChunkHeader& chunk, std::vector<unsigned char>& payload) {
+        payload.resize((std::size_t)chunk.size);
+        return std::fread(payload.data(), 1, payload.size(), m_file) == payload.size();
+    }
+
+    /// Skips the payload of the chunk just returned by next().
+    bool skip() {
+        return rec_seek(m_file, m_offset);
+    }
+
+    /// The recording file header.
+    const RecordingHeader& header() const { return m_header; }
+    /// The frames chunk index (empty if the recorder never finished).
+    const std::vector<IndexEntry>& index() const { return m_index; }
+
+    /// Calls fn(const FrameView&) for every valid frame in a frames chunk payload.
+    template <typename Fn>
+    static int for_each_frame(const std::vector<unsigned char>& payload, Fn fn) {
+        int frames = 0;
+        std::size_t pos = 0;
+        FrameView view;
+        while (pos + 4 <= payload.size()) {
+            std::size_t size = wire_get<std::uint32_t>(&payload[pos]);
+            pos += 4;
+            if (pos + size > payload.size())
+                break;
+            if (view.parse(&payload[pos], size) == FrameView::Ok) {
+                fn(view);
+                frames++;
+            }
+            pos += size;
+        }
+        return frames;
+    }
+
+private:
+    /// Reads the index from the trailer of a finished recording.
+    void read_index() {
+        unsigned char b[REC_TRAILER_BYTES];
+        if (m_size < REC_HEADER_BYTES + REC_TRAILER_BYTES || !rec_seek(m_file, m_size - REC_TRAILER_BYTES) ||
+            std::fread(b, 1, REC_TRAILER_BYTES, m_file) != REC_TRAILER_BYTES || wire_get<std::uint32_t>(b + 8) != REC_TRAILER)
+            return;
+        ChunkHeader chunk;
+        std::vector<unsigned char> payload;
+        if (!seek(wire_get<std::uint64_t>(b)) || !next(chunk) || chunk.type != ChunkIndex || !read(chunk, payload))
+            return;
+        for (int i = 0; i < chunk.count && (i + 1) * REC_INDEX_BYTES <= (int)payload.size(); ++i) {
+            const unsigned char* p = &payload[i * REC_INDEX_BYTES];
+            IndexEntry e;
+            e.offset     = wire_get<std::uint64_t>(p + 0);
+            e.first_tick = wire_get<std::int32_t>(p + 8);
+            e.last_tick  = wire_get<std::int32_t>(p + 12);
+            m_index.push_back(e);
+        }
+    }
+
+    std::FILE*              m_file;   // the open recording
+    RecordingHeader         m_header; // the file header
+    std::vector<IndexEntry> m_index;  // frames chunk index
+    std::uint64_t           m_offset; // offset of the next chunk header
+    std::uint64_t           m_size;   // file size
+};
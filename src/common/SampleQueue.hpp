@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.hpp"  // for State
+#include <atomic>      // for std::atomic
+#include <cstring>     // for std::memcpy
+#include <memory>      // for std::unique_ptr
+
+/// Read-only view of a queued telemetry sample.
+struct SampleView {
+    const State*  state;  ///< the controller state
+    const double* values; ///< the value of each plot channel (NaN if not plotted this tick)
+    int           count;  ///< the number of valid entries in values
+};
+
+/// Preallocated lock-free single-producer/single-consumer queue of telemetry
+/// samples. Every slot holds a State and room for the number of plot channels
+/// chosen at construction, so pushing is a bounded copy with no allocation.
+class SampleQueue {
+public:
+    /// Constructor.
+    SampleQueue(std::size_t capacity, int channels) :
+        m_capacity(capacity < 2 ? 2 : capacity),
+        m_channels(channels < 0 ? 0 : channels),
+        m_states(new State[m_capacity]),
+        m_counts(new int[m_capacity]),
+        m_values(new double[m_capacity * (m_channels > 0 ? m_channels : 1)]),
+        m_head(0),
+        m_tail(0)
+    { }
+
+    /// Copies a sample into the queue. Returns false if the queue is full.
+    bool try_push(const State& state, const double* values, int count) {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t next = tail + 1 == m_capacity ? 0 : tail + 1;
+        if (next == m_head.load(std::memory_order_acquire))
+            return false;
+        if (count > m_channels)
+            count = m_channels;
+        m_states[tail] = state;
+        m_counts[tail] = count;
+        if (count > 0)
+            std::memcpy(&m_values[tail * m_channels], values, count * sizeof(double));
+        m_tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /// Views the oldest sample. Returns false if the queue is empty.
+    bool front(SampleView& view) const {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+        view.state  = &m_states[head];
+        view.values = &m_values[head * m_channels];
+        view.count  = m_counts[head];
+        return true;
+    }
+
+    /// Removes the oldest sample. Only call after front() returned true.
+    void pop() {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        m_head.store(head + 1 == m_capacity ? 0 : head + 1, std::memory_order_release);
+    }
+
+private:
+    const std::size_t          m_capacity; // number of slots (one is always kept empty)
+    const int                  m_channels; // channel values per slot
+    std::unique_ptr<State[]>   m_states;   // state of each slot
+    std::unique_ptr<int[]>     m_counts;   // channel count of each slot
+    std::unique_ptr<double[]>  m_values;   // channel values of each slot
+    alignas(64) std::atomic<std::size_t> m_head; // next slot to read (consumer)
+    alignas(64) std::atomic<std::size_t> m_tail; // next slot to write (producer)
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>       // for std::atomic
+#include <cstdint>      // for std::uint32_t
+#include <cstring>      // for std::memcpy
+#include <type_traits>  // for std::is_trivially_copyable
+
+/// Single-writer sequence lock. The writer never blocks or waits, and readers 
+/// retry until they copy a consistent snapshot. This lets a real-time thread 
+/// publish a small struct to slower threads without sharing a mutex with them.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+public:
+    /// Constructor. Publishes a default constructed T.
+    SeqLock() : m_seq(0) { store(T()); }
+
+    /// Publishes a new value. Must only be called from a single writer thread.
+    void store(const T& value) {
+        std::uint32_t words[N] = {};
+        std::memcpy(words, &value, sizeof(T));
+        std::uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < N; ++i)
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /// Returns a copy of the most recently published value. Safe from any thread.
+    T load() const {
+        std::uint32_t words[N];
+        std::uint32_t seq0, seq1;
+        do {
+            seq0 = m_seq.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < N; ++i)
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq1 = m_seq.load(std::memory_order_relaxed);
+        } while ((seq0 & 1) || seq0 != seq1);
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr std::size_t N = (sizeof(T) + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t);
+    std::atomic<std::uint32_t> m_seq;      // odd while a store is in progress
+    std::atomic<std::uint32_t> m_words[N]; // the value, copied word by word
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "common.hpp"  // for PROTOCOL_VERSION
+#include <algorithm>   // for std::min
+#include <atomic>      // for std::atomic, std::atomic_thread_fence
+#include <cstdint>     // for std::uint32_t, std::uint64_t
+#include <cstring>     // for std::memcpy
+#include <new>         // for placement new
+#include <string>      // for std::string, std::to_string
+#ifdef __linux__
+#include <fcntl.h>     // for O_CREAT, O_RDWR
+#include <sys/mman.h>  // for shm_open, mmap
+#include <unistd.h>    // for ftruncate, close
+#endif
+
+//=============================================================================
+// SHARED MEMORY TELEMETRY RING
+//=============================================================================
+// Telemetry for a GUI on the same host as the controller, e.g. one watching
+// pendulum-sim. The controller publishes the same frames it would send over
+// UDP into a ring of fixed-size slots in a named POSIX shared memory segment,
+// and any number of GUIs read them without a syscall. The producer never
+// waits: a reader that falls a whole ring behind skips what was overwritten,
+// which then shows up as lost samples. Each slot carries a sequence number
+// (a seqlock), so a reader copies a frame out and keeps it only if the slot
+// wasn't rewritten meanwhile. Both ends run on one host, so the layout is
+// native rather than little-endian:
+//
+// Header (SHM_HEADER_BYTES):
+//   0  u32  magic       SHM_MAGIC
+//   4  u32  version     PROTOCOL_VERSION of the frames
+//   8  u32  slots       a power of two
+//  12  u32  slot_bytes  the largest frame a slot holds
+//  64  u64  head        frames published (atomic, on its own cache line)
+//
+// Slots (SHM_SLOT_HEADER + slot_bytes each, rounded to cache lines):
+//   0  u64  seq         2n+1 while frame n is being written, 2n+2 once it is complete
+//   8  u32  size        frame bytes
+//  16  the telemetry frame
+
+#define SHM_MAGIC        0x4D483450u // "P4HM" as little-endian bytes
+#define SHM_SLOTS        4096
+#define SHM_HEADER_BYTES 128
+#define SHM_SLOT_HEADER  16
+
+/// Name of the segment a controller serving TCP port publishes telemetry in.
+inline std::string shm_name(unsigned short tcp_port) {
+    return "/pendulum-" + std::to_string(tcp_port);
+}
+
+/// Single-producer, multi-consumer ring of telemetry frames in POSIX shared
+/// memory. The controller create()s it and publish()es; each GUI open()s its
+/// own read-only mapping and read()s. Only implemented on Linux; elsewhere
+/// create() and open() fail, so callers fall back to UDP.
+class ShmRing {
+public:
+    ShmRing() : m_map(nullptr), m_bytes(0), m_slots(0), m_slot_bytes(0), m_stride(0), m_next(0), m_owner(false) { }
+    ~ShmRing() { close(); }
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /// Creates (or replaces) the segment with slots slots (rounded up to a power of two) of up to slot_bytes each.
+    bool create(const std::string& name, int slots, std::size_t slot_bytes) {
+        close();
+#ifdef __linux__
+        static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the ring needs lock-free 64-bit atomics");
+        std::uint32_t count = 1;
+        while ((int)count < slots)
+            count <<= 1;
+        std::size_t stride = (SHM_SLOT_HEADER + slot_bytes + 63) / 64 * 64;
+        std::size_t bytes  = SHM_HEADER_BYTES + count * stride;
+        // a segment left by a controller that crashed is replaced, not reused
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+            return false;
+        void* map = MAP_FAILED;
+        if (ftruncate(fd, (off_t)bytes) == 0)
+            map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+        m_map   = (unsigned char*)map;
+        m_bytes = bytes;
+        m_name  = name;
+        m_owner = true;
+        set_layout(count, (std::uint32_t)slot_bytes, stride);
+        // the segment starts zeroed, so every slot reads as never written
+        new (head_ptr()) std::atomic<std::uint64_t>(0);
+        for (std::uint32_t i = 0; i < count; ++i)
+            new (slot(i)) std::atomic<std::uint64_t>(0);
+        std::uint32_t* header = (std::uint32_t*)m_map;
+        header[1] = PROTOCOL_VERSION;
+        header[2] = count;
+        header[3] = (std::uint32_t)slot_bytes;
+        // readers check the magic last
+        std::atomic_thread_fence(std::memory_order_release);
+        header[0] = SHM_MAGIC;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// Maps an existing segment read-only. Reading starts with the next frame published.
+    bool open(const std::string& name) {
+        close();
+#ifdef __linux__
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+        void* map = MAP_FAILED;
+        off_t bytes = lseek(fd, 0, SEEK_END);
+        if (bytes >= SHM_HEADER_BYTES)
+            map = mmap(nullptr, (std::size_t)bytes, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        m_map   = (unsigned char*)map;
+        m_bytes = (std::size_t)bytes;
+        m_name  = name;
+        m_owner = false;
+        const std::uint32_t* header = (const std::uint32_t*)m_map;
+        std::uint32_t count = header[2], slot_bytes = header[3];
+        std::size_t stride = (SHM_SLOT_HEADER + slot_bytes + 63) / 64 * 64;
+        if (header[0] != SHM_MAGIC || header[1] != PROTOCOL_VERSION || count == 0 || (count & (count - 1)) ||
+            SHM_HEADER_BYTES + count * stride > m_bytes) {
+            close();
+            return false;
+        }
+        set_layout(count, slot_bytes, stride);
+        m_next = head_ptr()->load(std::memory_order_acquire);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// Unmaps the segment, and removes it if this is the producer.
+    void close() {
+#ifdef __linux__
+        if (m_map) {
+            munmap(m_map, m_bytes);
+            if (m_owner)
+                shm_unlink(m_name.c_str());
+        }
+#endif
+        m_map   = nullptr;
+        m_owner = false;
+    }
+
+    /// Publishes a frame (producer only). Returns false if it doesn't fit in a slot.
+    bool publish(const unsigned char* data, std::size_t size) {
+        if (size > m_slot_bytes)
+            return false;
+        std::atomic<std::uint64_t>* head = head_ptr();
+        std::uint64_t n = head->load(std::memory_order_relaxed);
+        unsigned char* s = slot(n & (m_slots - 1));
+        std::atomic<std::uint64_t>* seq = (std::atomic<std::uint64_t>*)s;
+        seq->store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        *(std::uint32_t*)(s + 8) = (std::uint32_t)size;
+        std::memcpy(s + SHM_SLOT_HEADER, data, size);
+        seq->store(2 * n + 2, std::memory_order_release);
+        head->store(n + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Copies the next frame into buffer (at least slot_bytes() long). Returns
+    /// false if none is ready. Frames overwritten before they could be read are
+    /// added to skipped.
+    bool read(unsigned char* buffer, std::size_t& size, std::int64_t& skipped) {
+        for (;;) {
+            std::uint64_t head = head_ptr()->load(std::memory_order_acquire);
+            if (m_next >= head)
+                return false;
+            // a reader a whole ring behind jumps to the oldest frame still there
+            if (head - m_next > m_slots) {
+                skipped += (std::int64_t)(head - m_slots - m_next);
+                m_next = head - m_slots;
+            }
+            const unsigned char* s = slot(m_next & (m_slots - 1));
+            const std::atomic<std::uint64_t>* seq = (const std::atomic<std::uint64_t>*)s;
+            std::uint64_t before = seq->load(std::memory_order_acquire);
+            if (before == 2 * m_next + 2) {
+                size = std::min<std::size_t>(*(const volatile std::uint32_t*)(s + 8), m_slot_bytes);
+                std::memcpy(buffer, s + SHM_SLOT_HEADER, size);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq->load(std::memory_order_relaxed) == before) {
+                    m_next++;
+                    return true;
+                }
+            }
+            // the producer lapped us on this slot
+            skipped++;
+            m_next++;
+        }
+    }
+
+    /// Is the segment mapped?
+    bool is_open() const { return m_map != nullptr; }
+    /// The segment's name.
+    const std::string& name() const { return m_name; }
+    /// The largest frame a slot holds.
+    std::size_t slot_bytes() const { return m_slot_bytes; }
+
+private:
+    void set_layout(std::uint32_t slots, std::uint32_t slot_bytes, std::size_t stride) {
+        m_slots      = slots;
+        m_slot_bytes = slot_bytes;
+        m_stride     = stride;
+    }
+    std::atomic<std::uint64_t>* head_ptr() const { return (std::atomic<std::uint64_t>*)(m_map + 64); }
+    unsigned char* slot(std::uint64_t i) const { return m_map + SHM_HEADER_BYTES + i * m_stride; }
+
+    unsigned char* m_map;        // the mapped segment
+    std::size_t    m_bytes;      // the size of the mapping
+    std::string    m_name;       // the segment name
+    std::uint32_t  m_slots;      // slots in the ring (a power of two)
+    std::uint32_t  m_slot_bytes; // the largest frame a slot holds
+    std::size_t    m_stride;     // bytes from one slot to the next
+    std::uint64_t  m_next;       // the next frame to read (consumer only)
+    bool           m_owner;      // created the segment, so removes it on close
+};
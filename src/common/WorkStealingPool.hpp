@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>  // for std::max, std::min
+#include <deque>      // for std::deque
+#include <memory>     // for std::unique_ptr
+#include <mutex>      // for std::mutex, std::lock_guard
+#include <thread>     // for std::thread
+#include <vector>     // for std::vector
+
+/// Runs a batch of independent jobs on every core. Jobs are dealt round-robin
+/// into one deque per worker. Each worker takes jobs from the back of its own
+/// deque and, once that runs dry, steals from the front of the others', so a
+/// few long jobs don't leave the rest of the cores idle. Jobs are expected to
+/// be coarse (e.g. a whole simulation), so each deque is guarded by a mutex.
+class WorkStealingPool {
+public:
+    /// Constructor. Uses one worker per hardware thread if threads is 0.
+    WorkStealingPool(unsigned int threads = 0) :
+        m_threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u))
+    { }
+
+    /// Calls fn(job, worker) for every job in [0, jobs), returning once all have finished.
+    template <typename Fn>
+    void run(int jobs, Fn fn) {
+        int workers = (int)std::min<unsigned int>(m_threads, (unsigned int)std::max(jobs, 1));
+        std::vector<std::unique_ptr<Queue>> queues;
+        for (int w = 0; w < workers; ++w)
+            queues.emplace_back(new Queue());
+        for (int j = 0; j < jobs; ++j)
+            queues[j % workers]->jobs.push_back(j);
+        // no jobs are added once the workers start, so a worker that finds every deque empty is done
+        auto work = [&](int w) {
+            int job;
+            while (take(*queues[w], job, false) || steal(queues, w, job))
+                fn(job, w);
+        };
+        std::vector<std::thread> threads;
+        for (int w = 1; w < workers; ++w)
+            threads.emplace_back(work, w);
+        work(0);
+        for (auto& t : threads)
+            t.join();
+    }
+
+    /// The number of workers.
+    unsigned int threads() const { return m_threads; }
+
+private:
+    /// One worker's jobs.
+    struct Queue {
+        std::mutex      mtx;
+        std::deque<int> jobs;
+    };
+
+    /// Takes a job from the back (owner) or front (thief) of a deque.
+    static bool take(Queue& queue, int& job, bool front) {
+        std::lock_guard<std::mutex> lock(queue.mtx);
+        if (queue.jobs.empty())
+            return false;
+        if (front) {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        else {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        return true;
+    }
+
+    /// Steals a job from another worker, starting with the next one along.
+    static bool steal(std::vector<std::unique_ptr<Queue>>& queues, int w, int& job) {
+        int n = (int)queues.size();
+        for (int k = 1; k < n; ++k) {
+            if (take(*queues[(w + k) % n], job, true))
+                return true;
+        }
+        return false;
+    }
+
+    unsigned int m_threads; // the number of workers
+};
@@ -5,24 +5,40 @@
 using namespace mahi::com;
 using namespace mahi::util;
 
+#ifdef PENDULUM_SIM
+#define SERVER_IP "127.0.0.1"   // simulated pendulum on the local host
+#define CLIENT_IP "127.0.0.1"   // GUI on the local host
+#else
 #define SERVER_IP "172.22.11.2" // myRIO IP address over USB LAN
 #define CLIENT_IP "172.22.11.1" // Windows IP address over USB LAN
+#endif
 
 #define SERVER_TCP 55001        // myRIO TCP port
 #define SERVER_UDP 55002        // myRIO UDP port
 #define CLIENT_UDP 55003        // Windows UDP port
 
+#define MAX_FRAME_BYTES  1400   // batched UDP frames are flushed before they exceed this size
+#define PROTOCOL_VERSION 5      // bump whenever the TCP or UDP protocol changes
+
 /// Typedef this monstrosity so we don't have to type it out again.
 typedef RingBuffer<std::pair<Severity, std::string>> LogBuffer;
 
-/// Types of messages the GUI may send to the myRIO pendulum.
+/// Types of TCP messages between the GUI and the myRIO pendulum. Every packet
+/// starts with its type. The myRIO answers Hello, Ping and Channels, and once
+/// a GUI sends Subscribe it pushes Update at RunOptions::status_rate and Logs
+/// as records arrive, without being asked.
 enum Message {
-    Ping       = 0,
+    Ping       = 0,  ///< GUI asks for one Update (and any pending Logs)
     Enable     = 1,
     Disable    = 2,
     Feedback   = 3,
     Zero       = 4,
-    Shutdown   = 5
+    Shutdown   = 5,
+    Channels   = 6,  ///< first unknown channel ID; reply: first, count, labels
+    Hello      = 7,  ///< GUI's PROTOCOL_VERSION and u16 UDP port for telemetry (0: it reads shared memory); reply: Handshake
+    Subscribe  = 8,  ///< GUI asks for Update and Logs to be pushed
+    Update     = 9,  ///< myRIO sends u32 sequence (pushes count up from 1; replies repeat the latest push's), Status
+    Logs       = 10  ///< myRIO sends u32 sequence of the first record, count, then (severity, text) records
 };
 
 /// The feedback modes the myRIO pendulum can be in.
@@ -31,6 +47,32 @@ enum Mode {
     Midori  = 1
 };
 
+/// Phases of one controller loop tick that are timed on the myRIO.
+enum Phase {
+    PhaseRead    = 0, ///< reading inputs from the myRIO
+    PhaseControl = 1, ///< the user's control_encoder/control_midori
+    PhaseWrite   = 2, ///< writing outputs to the myRIO
+    PhaseStream  = 3, ///< queueing the sample for the telemetry thread
+    PhaseTick    = 4, ///< the whole tick, excluding the wait for the next one
+    PhaseCount   = 5
+};
+
+/// Real-time settings in effect on the myRIO controller (bits of Status::realtime).
+enum RealTime {
+    RtFifo      = 1, ///< the control thread runs under SCHED_FIFO
+    RtPinned    = 2, ///< the control thread is pinned to a CPU
+    RtLocked    = 4, ///< the controller's memory is locked in RAM
+    RtPrefault  = 8  ///< the control thread's stack and the heap were prefaulted
+};
+
+/// Execution time statistics of one loop phase over the last second [us].
+struct PhaseTiming {
+    double min = 0; ///< the fastest execution
+    double p50 = 0; ///< the median execution
+    double p99 = 0; ///< the 99th percentile execution
+    double max = 0; ///< the slowest execution
+};
+
 /// Status information for the myRIO pendulum controller.
 struct Status {
     bool   running   = false;         ///< is the controller loop running?
@@ -39,19 +81,41 @@ struct Status {
     double frequency = 0;             ///< the actual loop rate in Hz
     int    misses    = 0;             ///< the number of times our controller loop has missed its deadline
     double wait      = 0;             ///< the percentage of time we spend waiting for the next loop
+    int    channels  = 0;             ///< the number of plot channels registered with plot(...)
+    int    dropped   = 0;             ///< the number of samples dropped because the telemetry queue was full
+    int    realtime  = 0;             ///< the RealTime settings in effect
+    int    faults    = 0;             ///< the number of page faults the control thread has taken in its loop
+    PhaseTiming timing[PhaseCount];   ///< execution time statistics of each loop phase
 };
 
+/// Serialize PhaseTiming to Packet.
+inline Packet& operator<<(Packet& packet, const PhaseTiming& timing) {
+    return packet << timing.min << timing.p50 << timing.p99 << timing.max;
+}
+
+/// Deserialize Packet to PhaseTiming.
+inline Packet& operator>>(Packet& packet, PhaseTiming& timing) {
+    return packet >> timing.min >> timing.p50 >> timing.p99 >> timing.max;
+}
+
 /// Serialize Status to Packet.
 inline Packet& operator<<(Packet& packet, const Status& status) {
-    return packet << status.running << status.enabled << status.mode << status.frequency << status.misses << status.wait;
+    packet << status.running << status.enabled << status.mode << status.frequency << status.misses << status.wait << status.channels << status.dropped << status.realtime << status.faults;
+    for (auto& t : status.timing)
+        packet << t;
+    return packet;
 }
 
 /// Deserialize Packet to Status.
 inline Packet& operator>>(Packet& packet, Status& status) {
-    return packet >> status.running >> status.enabled >> status.mode >> status.frequency >> status.misses >> status.wait;
+    packet >> status.running >> status.enabled >> status.mode >> status.frequency >> status.misses >> status.wait >> status.channels >> status.dropped >> status.realtime >> status.faults;
+    for (auto& t : status.timing)
+        packet >> t;
+    return packet;
 }
 
-/// State of the myRIO pendulum controller.
+/// State of the myRIO pendulum controller. Streamed in the fixed layout
+/// described in Frame.hpp, which leaves out time since it is tick / loop rate.
 struct State {
     int    tick;    ///< the controller tick number    [0...N]
     double time;    ///< the controller time           [s]
@@ -62,52 +126,21 @@ struct State {
     char   enable;  ///< the amplifier enable state    [0=disabled,1=enabled]
 };
 
-/// Serialize State to Packet.
-inline Packet& operator<<(Packet& packet, const State& state) {
-    return packet << state.tick << state.time << state.sense << state.command << state.midori << state.encoder << state.enable;
-}
-
-/// Deserialize Packet to State.
-inline Packet& operator>>(Packet& packet, State& state) {
-    return packet >> state.tick >> state.time >> state.sense >> state.command >> state.midori >> state.encoder >> state.enable;
-}
-
-/// User defined plot value.
-struct Plot {
-    std::string label;
-    double      value;
+/// Handshake the myRIO sends in reply to the GUI's Message::Hello, which
+/// carries the GUI's PROTOCOL_VERSION and the UDP port it receives telemetry
+/// on. Both sides disconnect on a version mismatch.
+struct Handshake {
+    int    version    = PROTOCOL_VERSION; ///< the protocol version of the myRIO
+    double loop_rate  = 0;                ///< the controller loop rate [Hz]
+    int    decimation = 1;                ///< the number of controller ticks between streamed samples
 };
 
-/// Serialize Plot to Packet.
-inline Packet& operator<<(Packet& packet, const Plot& plot) {
-    return packet << plot.label << plot.value;
+/// Serialize Handshake to Packet.
+inline Packet& operator<<(Packet& packet, const Handshake& hello) {
+    return packet << hello.version << hello.loop_rate << hello.decimation;
 }
 
-/// Deserialize Packet to Plot.
-inline Packet& operator>>(Packet& packet, Plot& plot) {
-    return packet >> plot.label >> plot.value;
+/// Deserialize Packet to Handshake.
+inline Packet& operator>>(Packet& packet, Handshake& hello) {
+    return packet >> hello.version >> hello.loop_rate >> hello.decimation;
 }
-
-/// Merger of the controller state and all user plots for each loop tick.
-struct Data {
-    State state;
-    std::vector<Plot> plots;
-};
-
-/// Serialize Data to Packet.
-inline Packet& operator<<(Packet& packet, const Data& data) {
-    packet << data.state << (int)data.plots.size();
-    for (auto& p : data.plots)
-        packet << p;
-    return packet;
-};
-
-/// Deserialize Packet to Data.
-inline Packet& operator>>(Packet& packet, Data& data) {
-    int plots_size;
-    packet >> data.state >> plots_size;
-    data.plots.resize(plots_size);
-    for (auto& p : data.plots)
-        packet >> p;
-    return packet;
-};
\ No newline at end of file
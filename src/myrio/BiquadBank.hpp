@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>  // for std::max, std::fill
+#include <cmath>      // for std::tan, std::sin
+#include <vector>     // for std::vector
+#if defined(__AVX__)
+#include <immintrin.h>  // for __m256d
+#define BIQUAD_WIDTH 4
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>  // for __m128d
+#define BIQUAD_WIDTH 2
+#else
+// e.g. the myRIO's Cortex-A9, whose NEON unit has no double precision
+#define BIQUAD_WIDTH 1
+#endif
+
+/// Coefficients of one second order section, normalized so a0 = 1.
+struct Biquad {
+    double b0 = 1; ///< feedforward coefficient of x[n]
+    double b1 = 0; ///< feedforward coefficient of x[n-1]
+    double b2 = 0; ///< feedforward coefficient of x[n-2]
+    double a1 = 0; ///< feedback coefficient of y[n-1]
+    double a2 = 0; ///< feedback coefficient of y[n-2]
+};
+
+/// Designs a Butterworth low-pass filter of any order as a cascade of second
+/// order sections (plus a first order one for odd orders) by the bilinear
+/// transform, prewarped so the response is -3 dB at the cutoff. Every section
+/// has unity gain at DC.
+inline std::vector<Biquad> butterworth_lowpass(int order, double cutoff, double sample_rate) {
+    std::vector<Biquad> sections;
+    double K = std::tan(3.14159265358979323846 * cutoff / sample_rate);
+    for (int k = 0; k < order / 2; ++k) {
+        // each pole pair of the analog prototype is s^2 + s/Q + 1
+        double iQ   = 2 * std::sin(3.14159265358979323846 * (2 * k + 1) / (2 * order));
+        double norm = 1 / (1 + K * iQ + K * K);
+        Biquad s;
+        s.b0 = K * K * norm;
+        s.b1 = 2 * s.b0;
+        s.b2 = s.b0;
+        s.a1 = 2 * (K * K - 1) * norm;
+        s.a2 = (1 - K * iQ + K * K) * norm;
+        sections.push_back(s);
+    }
+    if (order % 2) {
+        // and the real pole s + 1
+        double norm = 1 / (1 + K);
+        Biquad s;
+        s.b0 = K * norm;
+        s.b1 = s.b0;
+        s.a1 = (K - 1) * norm;
+        sections.push_back(s);
+    }
+    return sections;
+}
+
+/// Bank of biquad cascades that filters several channels (lanes) at once.
+/// Coefficients and state are stored structure-of-arrays, one contiguous row
+/// per coefficient per section, so each step of the transposed direct form II
+/// recursion updates BIQUAD_WIDTH lanes with one SSE2/AVX instruction (one
+/// lane at a time elsewhere). Lanes with fewer sections than the bank pass
+/// through the rest. Only resize() allocates.
+class BiquadBank {
+public:
+    /// Constructor.
+    BiquadBank(int lanes = 1, int sections = 1) { resize(lanes, sections); }
+
+    /// Reallocates the bank for lanes channels of up to sections sections each, all passing their input through.
+    void resize(int lanes, int sections) {
+        m_lanes    = std::max(lanes, 1);
+        m_sections = std::max(sections, 1);
+        // pad the lanes to whole vectors so process() has no remainder loop
+        m_stride   = (m_lanes + BIQUAD_WIDTH - 1) / BIQUAD_WIDTH * BIQUAD_WIDTH;
+        m_coefs.assign((std::size_t)m_sections * 5 * m_stride, 0.0);
+        m_state.assign((std::size_t)m_sections * 2 * m_stride, 0.0);
+        m_x.assign(m_stride, 0.0);
+        for (int s = 0; s < m_sections; ++s)
+            for (int l = 0; l < m_stride; ++l)
+                set_section(l, s, Biquad());
+    }
+
+    /// Sets the coefficients of one section of one lane.
+    void set_section(int lane, int section, const Biquad& c) {
+        double* row = &m_coefs[(std::size_t)section * 5 * m_stride];
+        row[0 * m_stride + lane] = c.b0;
+        row[1 * m_stride + lane] = c.b1;
+        row[2 * m_stride + lane] = c.b2;
+        row[3 * m_stride + lane] = c.a1;
+        row[4 * m_stride + lane] = c.a2;
+    }
+
+    /// Sets a lane to a cascade (which must fit in the bank), passing the remaining sections through.
+    void set_lane(int lane, const std::vector<Biquad>& cascade) {
+        for (int s = 0; s < m_sections; ++s)
+            set_section(lane, s, s < (int)cascade.size() ? cascade[s] : Biquad());
+    }
+
+    /// Sets the state of every section as if each lane's input had been x[lane] forever.
+    void reset(const double* x) {
+        for (int l = 0; l < m_lanes; ++l)
+            reset_lane(l, x[l]);
+    }
+
+    /// Sets the state of one lane's sections as if its input had been x forever.
+    void reset_lane(int lane, double x) {
+        double v = x;
+        for (int s = 0; s < m_sections; ++s) {
+            const double* c = &m_coefs[(std::size_t)s * 5 * m_stride + lane];
+            double y  = v * (c[0] + c[m_stride] + c[2 * m_stride]) / (1 + c[3 * m_stride] + c[4 * m_stride]);
+            double z2 = c[2 * m_stride] * v - c[4 * m_stride] * y;
+            double z1 = c[1 * m_stride] * v - c[3 * m_stride] * y + z2;
+            m_state[(std::size_t)s * 2 * m_stride + lane]            = z1;
+            m_state[(std::size_t)s * 2 * m_stride + m_stride + lane] = z2;
+            v = y;
+        }
+    }
+
+    /// Filters one sample of every lane: x[lane] in, the filtered value out.
+    void process(double* x) {
+        std::copy(x, x + m_lanes, m_x.begin());
+        double* v = m_x.data();
+        const std::size_t row = (std::size_t)m_stride;
+        // each block of lanes runs through every section with its signal kept in registers
+        for (int l = 0; l < m_stride; l += BIQUAD_WIDTH) {
+            const double* c = &m_coefs[l];
+            double*       z = &m_state[l];
+#if BIQUAD_WIDTH == 4
+            __m256d in = _mm256_loadu_pd(v + l);
+            for (int s = 0; s < m_sections; ++s, c += 5 * row, z += 2 * row) {
+                __m256d out = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(c), in), _mm256_loadu_pd(z));
+                _mm256_storeu_pd(z, _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_loadu_pd(c + row), in), _mm256_mul_pd(_mm256_loadu_pd(c + 3 * row), out)), _mm256_loadu_pd(z + row)));
+                _mm256_storeu_pd(z + row, _mm256_sub_pd(_mm256_mul_pd(_mm256_loadu_pd(c + 2 * row), in), _mm256_mul_pd(_mm256_loadu_pd(c + 4 * row), out)));
+                in = out;
+            }
+            _mm256_storeu_pd(v + l, in);
+#elif BIQUAD_WIDTH == 2
+            __m128d in = _mm_loadu_pd(v + l);
+            for (int s = 0; s < m_sections; ++s, c += 5 * row, z += 2 * row) {
+                __m128d out = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(c), in), _mm_loadu_pd(z));
+                _mm_storeu_pd(z, _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm_loadu_pd(c + row), in), _mm_mul_pd(_mm_loadu_pd(c + 3 * row), out)), _mm_loadu_pd(z + row)));
+                _mm_storeu_pd(z + row, _mm_sub_pd(_mm_mul_pd(_mm_loadu_pd(c + 2 * row), in), _mm_mul_pd(_mm_loadu_pd(c + 4 * row), out)));
+                in = out;
+            }
+            _mm_storeu_pd(v + l, in);
+#else
+            double in = v[l];
+            for (int s = 0; s < m_sections; ++s, c += 5 * row, z += 2 * row) {
+                double out = c[0] * in + z[0];
+                z[0]   = c[row] * in - c[3 * row] * out + z[row];
+                z[row] = c[2 * row] * in - c[4 * row] * out;
+                in = out;
+            }
+            v[l] = in;
+#endif
+        }
+        std::copy(m_x.begin(), m_x.begin() + m_lanes, x);
+    }
+
+    /// The number of channels filtered.
+    int lanes() const { return m_lanes; }
+    /// The number of sections in every lane's cascade.
+    int sections() const { return m_sections; }
+
+private:
+    int                 m_lanes;    // channels filtered
+    int                 m_sections; // sections per cascade
+    int                 m_stride;   // lanes rounded up to whole vectors
+    std::vector<double> m_coefs;    // b0, b1, b2, a1, a2 rows of each section, m_stride lanes each
+    std::vector<double> m_state;    // z1, z2 rows of each section, m_stride lanes each
+    std::vector<double> m_x;        // padded input/output of process()
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "IHardware.hpp"   // for Inputs, Input
+#include "BiquadBank.hpp"  // for BiquadBank, butterworth_lowpass
+#include <algorithm>       // for std::max
+
+/// Inputs after the conditioning stage: filtered, and differentiated after filtering.
+struct Conditioned {
+    double sense        = 0; ///< the filtered amplifier sense voltage [V]
+    double midori       = 0; ///< the filtered Midori pot voltage [V]
+    double encoder      = 0; ///< the filtered encoder counts [counts]
+    double sense_rate   = 0; ///< the derivative of the filtered sense voltage [V/s]
+    double midori_rate  = 0; ///< the derivative of the filtered Midori pot voltage [V/s]
+    double encoder_rate = 0; ///< the derivative of the filtered encoder counts [counts/s]
+};
+
+/// Pre-control conditioning stage. Every tick, the sense, Midori and encoder
+/// inputs are low-pass filtered together as the lanes of one BiquadBank and
+/// then differentiated by backward difference. Inputs without a low-pass are
+/// passed through (and still differentiated).
+class Conditioner {
+public:
+    /// Constructor. Every input is passed through.
+    Conditioner() : m_rate(1), m_first(true) {
+        for (int i = 0; i < InputCount; ++i) {
+            m_cutoffs[i] = 0;
+            m_orders[i]  = 0;
+        }
+    }
+
+    /// Low-pass filters an input with a Butterworth filter of the given order, or passes it through if cutoff is 0.
+    void set_lowpass(Input input, double cutoff, int order) {
+        m_cutoffs[input] = cutoff;
+        m_orders[input]  = cutoff > 0 ? std::max(order, 1) : 0;
+    }
+
+    /// Designs the filters for a loop rate. The next update() starts them in steady state.
+    void start(double sample_rate) {
+        int sections = 1;
+        for (int i = 0; i < InputCount; ++i)
+            sections = std::max(sections, (m_orders[i] + 1) / 2);
+        m_bank.resize(InputCount, sections);
+        for (int i = 0; i < InputCount; ++i) {
+            // a cutoff at or above Nyquist can't be realized, so pass the input through
+            if (m_orders[i] > 0 && m_cutoffs[i] < sample_rate / 2)
+                m_bank.set_lane(i, butterworth_lowpass(m_orders[i], m_cutoffs[i], sample_rate));
+        }
+        m_rate  = sample_rate;
+        m_first = true;
+    }
+
+    /// Conditions this tick's inputs.
+    const Conditioned& update(const Inputs& inputs) {
+        double x[InputCount] = {inputs.sense, inputs.midori, (double)inputs.encoder};
+        if (m_first)
+            m_bank.reset(x);
+        m_bank.process(x);
+        if (m_first) {
+            m_out.sense   = x[InputSense];
+            m_out.midori  = x[InputMidori];
+            m_out.encoder = x[InputEncoder];
+            m_first = false;
+        }
+        m_out.sense_rate   = (x[InputSense]   - m_out.sense)   * m_rate;
+        m_out.midori_rate  = (x[InputMidori]  - m_out.midori)  * m_rate;
+        m_out.encoder_rate = (x[InputEncoder] - m_out.encoder) * m_rate;
+        m_out.sense   = x[InputSense];
+        m_out.midori  = x[InputMidori];
+        m_out.encoder = x[InputEncoder];
+        return m_out;
+    }
+
+    /// The inputs as of the last update().
+    const Conditioned& output() const { return m_out; }
+
+private:
+    BiquadBank  m_bank;                 // one lane per Input
+    double      m_cutoffs[InputCount];  // low-pass cutoff of each input [Hz]
+    int         m_orders[InputCount];   // low-pass order of each input, or 0 to pass it through
+    double      m_rate;                 // the loop rate [Hz]
+    bool        m_first;                // is the next update the first since start()?
+    Conditioned m_out;                  // the conditioned inputs
+};
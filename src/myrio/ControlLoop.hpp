@@ -0,0 +1,295 @@
+#pragma once
+
+#include "IPendulum.hpp"  // for IPendulum
+#include "Histogram.hpp"  // for Histogram
+#include "Realtime.hpp"   // for thread_page_faults
+#include "BiquadBank.hpp" // for BiquadBank, butterworth_lowpass
+#include <algorithm>      // for std::fill, std::copy, std::max
+#include <chrono>         // for std::chrono::steady_clock
+#include <cmath>          // for std::lround
+#include <limits>         // for std::numeric_limits
+#include <vector>         // for std::vector
+
+// The control loop shared by IPendulum and PendulumRunner. It is a template
+// so that PendulumRunner can bind its controller and I/O backend at compile
+// time and have them inlined into the loop.
+
+typedef std::chrono::steady_clock SteadyClock;
+
+/// Value of a channel that was not plotted this tick.
+static const double NOT_PLOTTED = std::numeric_limits<double>::quiet_NaN();
+
+/// Measures the actual loop rate over an update interval.
+class RateMonitor {
+public:
+    RateMonitor(mahi::util::Time updateInterval = mahi::util::seconds(1)) : 
+        m_updateInterval(updateInterval),
+        m_nextUpdateTime(m_updateInterval),
+        m_rate(0), m_ticks(0)
+    { }
+    void tick() {
+        m_ticks++;
+    }
+    bool update(const mahi::util::Time& t) {
+        if (t > m_nextUpdateTime) {
+            m_rate = m_ticks / m_updateInterval.as_seconds();
+            m_nextUpdateTime += m_updateInterval;
+            m_ticks = 0;
+            return true;
+        }
+        return false;
+    }
+    double rate() const {
+        return m_rate;
+    }
+private:
+    Time m_updateInterval;
+    Time m_nextUpdateTime;
+    double m_rate;
+    double m_ticks;
+};
+
+/// Aggregates the execution time of each loop phase and summarizes it as PhaseTiming.
+class PhaseMonitor {
+public:
+    void record(Phase phase, SteadyClock::time_point start, SteadyClock::time_point end) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        m_hists[phase].record(ns > 0 ? (std::uint64_t)ns : 0);
+    }
+    void summarize(PhaseTiming* timing) {
+        for (int p = 0; p < PhaseCount; ++p) {
+            timing[p].min = m_hists[p].min() / 1000.0;
+            timing[p].p50 = m_hists[p].percentile(0.50) / 1000.0;
+            timing[p].p99 = m_hists[p].percentile(0.99) / 1000.0;
+            timing[p].max = m_hists[p].max() / 1000.0;
+            m_hists[p].clear();
+        }
+    }
+private:
+    Histogram m_hists[PhaseCount];
+};
+
+/// Order of the anti-alias filter in front of telemetry decimation.
+#define ANTIALIAS_ORDER  4
+/// Cutoff of the anti-alias filter as a fraction of the telemetry rate.
+#define ANTIALIAS_CUTOFF 0.25
+
+/// Anti-alias decimation of telemetry. The sense, command and Midori voltages
+/// and every plot channel go through an ANTIALIAS_ORDER Butterworth low-pass
+/// at ANTIALIAS_CUTOFF of the telemetry rate (one lane each of a BiquadBank)
+/// before every Nth tick is kept, so content above the telemetry Nyquist rate
+/// is attenuated (by 24 dB at it, more beyond) instead of folding into the
+/// plots. A plot channel holds its last value through ticks it wasn't plotted
+/// on, and stays NaN in samples it wasn't plotted on at all. The encoder and
+/// enable are taken from the last tick since filtering them is meaningless.
+class Decimator {
+public:
+    /// Constructor. Preallocates lanes for max_channels plot channels.
+    Decimator(int max_channels) :
+        m_max(std::max(max_channels, 0)),
+        m_bank(3 + m_max, (ANTIALIAS_ORDER + 1) / 2),
+        m_x(3 + m_max, 0.0),
+        m_held(m_max, 0.0),
+        m_plotted(m_max, false),
+        m_counts(m_max, 0),
+        m_values(std::max(m_max, 1), NOT_PLOTTED),
+        m_primed(false), m_channels(0), m_count(0)
+    { }
+
+    /// Designs the filter for a loop_rate streamed every decimation ticks.
+    void start(double loop_rate, int decimation) {
+        auto cascade = butterworth_lowpass(ANTIALIAS_ORDER, ANTIALIAS_CUTOFF * loop_rate / std::max(decimation, 1), loop_rate);
+        for (int l = 0; l < m_bank.lanes(); ++l)
+            m_bank.set_lane(l, cascade);
+        m_primed = false;
+    }
+
+    /// Adds a tick. Returns true when it completes a sample, which state(),
+    /// values() and channels() then hold until the next one completes.
+    bool add(const State& state, const double* values, int channels, int decimation) {
+        m_x[0] = state.sense;
+        m_x[1] = state.command;
+        m_x[2] = state.midori;
+        for (int i = 0; i < channels; ++i) {
+            // NaN != NaN, so unplotted ticks hold the last value
+            if (values[i] == values[i]) {
+                // a channel starts from its first value rather than ringing up from zero
+                if (!m_plotted[i] && m_primed)
+                    m_bank.reset_lane(3 + i, values[i]);
+                m_plotted[i] = true;
+                m_held[i] = values[i];
+                m_counts[i]++;
+            }
+        }
+        std::copy(m_held.begin(), m_held.end(), m_x.begin() + 3);
+        if (!m_primed) {
+            m_bank.reset(m_x.data());
+            m_primed = true;
+        }
+        m_bank.process(m_x.data());
+        m_channels = std::max(m_channels, channels);
+        if (state.tick % decimation != 0)
+            return false;
+        // the sample is stamped with its last tick
+        m_state         = state;
+        m_state.sense   = m_x[0];
+        m_state.command = m_x[1];
+        m_state.midori  = m_x[2];
+        for (int i = 0; i < m_channels; ++i) {
+            m_values[i] = m_counts[i] ? m_x[3 + i] : NOT_PLOTTED;
+            m_counts[i] = 0;
+        }
+        m_count    = m_channels;
+        m_channels = 0;
+        return true;
+    }
+
+    /// The filtered state of the last completed sample.
+    const State& state() const { return m_state; }
+    /// The filtered channel values of the last completed sample.
+    const double* values() const { return m_values.data(); }
+    /// The number of channel values of the last completed sample.
+    int channels() const { return m_count; }
+
+private:
+    int                 m_max;      // plot channels
+    BiquadBank          m_bank;     // sense, command, Midori, then each plot channel
+    std::vector<double> m_x;        // input and output of m_bank this tick
+    std::vector<double> m_held;     // last plotted value of each channel
+    std::vector<bool>   m_plotted;  // has each channel ever been plotted?
+    std::vector<int>    m_counts;   // the number of ticks each channel was plotted this sample
+    std::vector<double> m_values;   // filtered channel values of the last sample
+    State               m_state;    // filtered state of the last sample
+    bool                m_primed;   // has the filter been seeded with the first tick?
+    int                 m_channels; // channels seen in this sample
+    int                 m_count;    // channels in the last sample
+};
+
+/// Stands in for Timer when the loop runs as fast as it can instead of in real
+/// time, e.g. against the simulated plant. Every tick takes exactly one period
+/// and wait() returns at once, so nothing is ever missed.
+class FreeRunTimer {
+public:
+    FreeRunTimer(Frequency loop_rate) : m_rate(loop_rate.as_hertz()), m_ticks(0) { }
+    Time wait() { m_ticks++; return get_elapsed_time(); }
+    int64 get_elapsed_ticks() const { return m_ticks; }
+    Time get_elapsed_time() const { return seconds(m_ticks / m_rate); }
+    Time get_elapsed_time_ideal() const { return get_elapsed_time(); }
+    int64 get_misses() const { return 0; }
+    double get_wait_ratio() const { return 0; }
+private:
+    double m_rate;  // ticks per second
+    int64  m_ticks; // ticks elapsed
+};
+
+template <class Control, class Hardware>
+void IPendulum::run_loop(Frequency loop_rate, const RunOptions& options, int realtime, Control control, Hardware& hw) {
+    // wake the telemetry thread once per full batch rather than per sample
+    int queued = 0;
+    auto publish = [this, &queued, &options](const State& state, const double* values, int channels) {
+        if (!m_samples->try_push(state, values, channels))
+            return false;
+        if (++queued >= options.batch) {
+            queued = 0;
+            m_samples_ready.ring();
+        }
+        return true;
+    };
+    run_loop<Timer>(loop_rate, options, realtime, control, hw, publish);
+}
+
+template <class Pacer, class Control, class Hardware, class Publish>
+void IPendulum::run_loop(Frequency loop_rate, const RunOptions& options, int realtime, Control control, Hardware& hw, Publish publish) {
+    State state;
+    Status status;
+    int dropped = 0;
+    Inputs inputs;
+    Outputs outputs;
+    long faults = thread_page_faults();
+    // telemetry is low-pass filtered down to its own rate, and bookkeeping happens at a slower one
+    bool antialias = options.antialias && options.decimation > 1;
+    Decimator decimator(m_max_channels);
+    decimator.start(loop_rate.as_hertz(), options.decimation);
+    int housekeeping = std::max((int)std::lround(loop_rate.as_hertz() / options.housekeeping_rate), 1);
+    m_conditioner.start(loop_rate.as_hertz());
+    // timing
+    Pacer timer(loop_rate);
+    RateMonitor monitor;
+    PhaseMonitor phases;
+    // start the control loop
+    while (m_running) {
+        auto t_tick = SteadyClock::now();
+        // read commands
+        Mode mode    = (Mode)m_mode.load();
+        char enabled = m_enabled.load();
+        // check for encoder zero (a plain load first, so there's no atomic write every tick)
+        if (m_zero.load(std::memory_order_relaxed) && m_zero.exchange(false))
+            hw.zero_encoder();
+        auto t_read = SteadyClock::now();
+        // read inputs
+        hw.read(inputs);
+        state.tick    = timer.get_elapsed_ticks();
+        state.time    = timer.get_elapsed_time_ideal().as_seconds();
+        state.sense   = inputs.sense;
+        state.midori  = inputs.midori;
+        state.encoder = inputs.encoder;
+        state.enable  = enabled;
+        m_conditioner.update(inputs);
+        auto t_control = SteadyClock::now();
+        state.command = control(mode, state.time, inputs);
+        auto t_write = SteadyClock::now();
+        outputs.command = enabled ? state.command : 0;
+        outputs.enable  = enabled != 0;
+        hw.write(outputs);
+        auto t_stream = SteadyClock::now();
+        // hand data to the telemetry thread (bounded copy, never blocks)
+        int channels = m_channels.load(std::memory_order_relaxed);
+        if (antialias) {
+            if (decimator.add(state, m_values.get(), channels, options.decimation) &&
+                !publish(decimator.state(), decimator.values(), decimator.channels()))
+                dropped++;
+        }
+        else if (state.tick % options.decimation == 0) {
+            if (!publish(state, m_values.get(), channels))
+                dropped++;
+        }
+        std::fill(m_values.get(), m_values.get() + channels, NOT_PLOTTED);
+        if (s_stop)
+            m_running = false;
+        auto t_end = SteadyClock::now();
+        // aggregate phase timing and summarize it once per second
+        phases.record(PhaseRead,    t_read,    t_control);
+        phases.record(PhaseControl, t_control, t_write);
+        phases.record(PhaseWrite,   t_write,   t_stream);
+        phases.record(PhaseStream,  t_stream,  t_end);
+        phases.record(PhaseTick,    t_tick,    t_end);
+        monitor.tick();
+        // bookkeeping runs at the housekeeping rate, not every tick
+        if (state.tick % housekeeping == 0) {
+            if (monitor.update(timer.get_elapsed_time())) {
+                phases.summarize(status.timing);
+                // faults in the loop are what prefaulting and mlock are meant to prevent
+                if (faults >= 0)
+                    status.faults = (int)(thread_page_faults() - faults);
+            }
+            status.running   = m_running;
+            status.enabled   = enabled;
+            status.mode      = mode;
+            status.frequency = monitor.rate();
+            status.misses    = (int)timer.get_misses();
+            status.wait      = timer.get_wait_ratio();
+            status.channels  = channels;
+            status.dropped   = dropped;
+            status.realtime  = realtime;
+            m_status.store(status);
+        }
+        timer.wait();
+    }
+    // the last tick usually isn't a housekeeping one, so publish that the loop stopped
+    status.running  = false;
+    status.misses   = (int)timer.get_misses();
+    status.wait     = timer.get_wait_ratio();
+    status.channels = m_channels.load(std::memory_order_relaxed);
+    status.dropped  = dropped;
+    m_status.store(status);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>   // for std::atomic, std::atomic_thread_fence
+#include <cstdint>  // for std::uint32_t
+#ifdef __linux__
+#include <ctime>          // for timespec
+#include <linux/futex.h>  // for FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#include <sys/syscall.h>  // for SYS_futex
+#include <unistd.h>       // for syscall
+#else
+#include <chrono>  // for std::chrono::milliseconds
+#include <thread>  // for std::this_thread::sleep_for
+#endif
+
+/// Lets a real-time thread wake one sleeping thread without blocking. ring()
+/// costs a fence and a load while the other thread is busy, and one futex
+/// wake when it is asleep. wait() sleeps on a futex until rung or the timeout
+/// passes. Off Linux, wait() falls back to polling with a 1 ms sleep.
+class Doorbell {
+public:
+    /// Constructor.
+    Doorbell() : m_rings(0), m_waiting(false) { }
+
+    /// Wakes the waiting thread, if there is one. Call after publishing the
+    /// data it waits on. Never blocks.
+    void ring() {
+        // orders the caller's publish before the load of m_waiting (pairs with the fence in wait)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_waiting.load(std::memory_order_relaxed))
+            return;
+        m_rings.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_rings), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+    }
+
+    /// Sleeps until rung or timeout_ms passes, unless ready() already returns
+    /// true. ready() is checked after announcing the wait, so a ring() that
+    /// follows the data ready() looks for is never missed.
+    template <class Ready>
+    void wait(Ready ready, int timeout_ms) {
+        std::uint32_t rings = m_rings.load(std::memory_order_acquire);
+        m_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) {
+#ifdef __linux__
+            timespec timeout;
+            timeout.tv_sec  = timeout_ms / 1000;
+            timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            // returns at once if a ring() has bumped m_rings since it was loaded
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_rings), FUTEX_WAIT_PRIVATE, rings, &timeout, nullptr, 0);
+#else
+            (void)rings;
+            (void)timeout_ms;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+        }
+        m_waiting.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be a plain 32-bit integer");
+    std::atomic<std::uint32_t> m_rings;   // bumped by every ring() that finds a waiter; the futex word
+    std::atomic_bool           m_waiting; // is the other thread in (or about to enter) wait()?
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Mahi/Util.hpp>  // for Frequency
+
+/// Inputs read from the pendulum hardware each controller tick.
+struct Inputs {
+    double sense   = 0; ///< the amplifier sense voltage   [V]
+    double midori  = 0; ///< the Midori pot voltage        [V]
+    int    encoder = 0; ///< the encoder counts            [counts]
+};
+
+/// The analog and encoder inputs, e.g. to pick which the conditioning stage filters.
+enum Input {
+    InputSense   = 0, ///< Inputs::sense
+    InputMidori  = 1, ///< Inputs::midori
+    InputEncoder = 2, ///< Inputs::encoder
+    InputCount   = 3
+};
+
+/// Outputs written to the pendulum hardware each controller tick.
+struct Outputs {
+    double command = 0;     ///< the amplifier command voltage [V]
+    bool   enable  = false; ///< the amplifier enable state
+};
+
+/// Pendulum I/O backend interface. Abstract base class. All functions are 
+/// called from the control thread, starting with open() and ending with close().
+class IHardware {
+public:
+    /// Destructor.
+    virtual ~IHardware() { }
+    /// Opens the I/O for a controller running at the given loop rate.
+    virtual bool open(mahi::util::Frequency loop_rate) = 0;
+    /// Puts the outputs in a safe state and closes the I/O.
+    virtual void close() = 0;
+    /// Reads all inputs.
+    virtual void read(Inputs& inputs) = 0;
+    /// Writes all outputs.
+    virtual void write(const Outputs& outputs) = 0;
+    /// Zeros the encoder at its current position.
+    virtual void zero_encoder() = 0;
+    /// Name of the backend for logging.
+    virtual const char* name() const = 0;
+};
@@ -1,152 +1,465 @@
 #include "IPendulum.hpp"
-#include <Mahi/Daq.hpp>   // for MyRio
+#include <algorithm>        // for std::max
+#include <chrono>           // for std::chrono::milliseconds
+#include <cmath>            // for std::lround
+#include <cstdlib>          // for std::atoi, std::atof
+#include <cstring>          // for std::strcmp
+#include <mutex>            // for std::call_once
+#include "ControlLoop.hpp"  // for IPendulum::run_loop, NOT_PLOTTED
+#include "Frame.hpp"        // for FrameWriter
+#include "Realtime.hpp"     // for set_thread_priority, set_thread_cpu, lock_memory
+#ifdef PENDULUM_SIM
+#include "SimHardware.hpp"    // for SimHardware
+#else
+#include "MyRioHardware.hpp"  // for MyRioHardware
+#endif
 
-using namespace mahi::daq;
+std::atomic_bool IPendulum::s_stop(false);
 
-static bool g_stop = false;
-static bool g_zero = false;
+static RemoteLog g_remote_log(256);
+
+RemoteLog& remote_log() {
+    return g_remote_log;
+}
 
 template <class Formatter>
 class MyRioLogWritter : public Writer {
 public:
-    MyRioLogWritter(Severity max_severity = Debug) : Writer(max_severity), logs(100) {}
+    MyRioLogWritter(Severity max_severity = Debug) : Writer(max_severity) {}
 
     virtual void write(const LogRecord& record) override {
-        auto log = std::pair<Severity, std::string>(record.get_severity(), Formatter::format(record));
-        logs.push_back(log);
+        remote_log().log_text(record.get_severity(), Formatter::format(record));
     }
-    LogBuffer logs;
 };
 
 static MyRioLogWritter<TxtFormatter> remote_writer;
 
-class RateMonitor {
-public:
-    RateMonitor(mahi::util::Time updateInterval = mahi::util::seconds(1)) : 
-        m_updateInterval(updateInterval),
-        m_nextUpdateTime(m_updateInterval),
-        m_rate(0), m_ticks(0)
-    { }
-    void tick() {
-        m_ticks++;
-    }
-    void update(const mahi::util::Time& t) {
-        if (t > m_nextUpdateTime) {
-            m_rate = m_ticks / m_updateInterval.as_seconds();
-            m_nextUpdateTime += m_updateInterval;
-            m_ticks = 0;
-        }
-    }
-    double rate() const {
-        return m_rate;
-    }
-private:
-    Time m_updateInterval;
-    Time m_nextUpdateTime;
-    double m_rate;
-    double m_ticks;
-};
-
+/// Answers a newly connected GUI's first message, which must be Message::Hello. Returns true if it speaks our protocol.
+static bool handshake(TcpSocket& tcp, Packet& packet, const Handshake& hello, unsigned short& udp_port) {
+    int msg;
+    packet >> msg;
+    if (msg != Message::Hello) {
+        LOG(Error) << "GUI did not send a handshake, so it speaks a protocol older than version " << PROTOCOL_VERSION << ". Please update it.";
+        return false;
+    }
+    int version;
+    packet >> version;
+    packet >> udp_port;
+    Packet reply;
+    reply << (int)Message::Hello << hello;
+    tcp.send(reply);
+    if (version != PROTOCOL_VERSION) {
+        LOG(Error) << "GUI speaks protocol version " << version << " but this controller speaks version " << PROTOCOL_VERSION << ".";
+        return false;
+    }
+    return true;
+}
 
-IPendulum::IPendulum() : 
-    m_running(false)
+IPendulum::IPendulum(std::unique_ptr<IHardware> hardware, int max_channels) : 
+    m_hardware(std::move(hardware)),
+    m_running(false),
+    m_enabled(false),
+    m_mode(Mode::Encoder),
+    m_zero(false),
+    m_io_failed(false),
+    m_realtime(0),
+    m_max_channels(std::max(max_channels, 0)),
+    m_values(new double[std::max(max_channels, 1)]),
+    m_labels(new std::string[std::max(max_channels, 1)]),
+    m_channels(0),
+    m_channels_logged(0),
+    m_overflowed(false),
+    m_status_seq(0),
+    m_log_seq(0)
 {
-    if (MahiLogger) {
-        MahiLogger->add_writer(&remote_writer);
-        MahiLogger->set_max_severity(Debug);
-    }
-    auto ctrl_hand = [](CtrlEvent event) { 
-        static int count = 0;
-        LOG(Warning) << "Ctrl-C Pressed";
-        g_stop = true;
-        count++;
-        if (count == 2)
-            abort();
-        return true; 
-    };
-    register_ctrl_handler(ctrl_hand);
+    std::fill(m_values.get(), m_values.get() + m_max_channels, NOT_PLOTTED);
+    // process-wide setup happens once, however many pendulums are made (e.g. by a sweep)
+    static std::once_flag setup;
+    std::call_once(setup, []() {
+        if (MahiLogger) {
+            MahiLogger->add_writer(&remote_writer);
+            MahiLogger->set_max_severity(Debug);
+        }
+        auto ctrl_hand = [](CtrlEvent event) { 
+            static int count = 0;
+            LOG(Warning) << "Ctrl-C Pressed";
+            s_stop = true;
+            count++;
+            if (count == 2)
+                abort();
+            return true; 
+        };
+        register_ctrl_handler(ctrl_hand);
+    });
 }
 
 IPendulum::~IPendulum() {
     // does nothing
 }
 
-void IPendulum::run(Frequency loop_rate) {
+bool IPendulum::run(Frequency loop_rate, const RunOptions& options) {
     if (m_running)
     {
         LOG(Warning) << "The pendulum controller is already running!";
-        return;
+        return false;
     }
-    // wait for TCP connection from GUI client
-    LOG(Info) << "Waiting for GUI to connect ...";
-    TcpSocket   tcp;
+    if (!options.replay.empty())
+        return replay(options.replay, options);
+    // normalize options
+    RunOptions opts = options;
+    opts.batch      = std::max(opts.batch, 1);
+    opts.decimation = std::max(opts.decimation, 1);
+    opts.queue      = std::max(opts.queue, 2);
+    opts.status_rate = std::min(std::max(opts.status_rate, 1.0), 1000.0);
+    opts.housekeeping_rate = std::min(std::max(opts.housekeeping_rate, 1.0), loop_rate.as_hertz());
+    // the control loop can run faster than the GUI needs to see it
+    if (opts.telemetry_rate > 0)
+        opts.decimation = std::max((int)std::lround(loop_rate.as_hertz() / opts.telemetry_rate), 1);
+    // GUIs on this host can read telemetry from shared memory, so it must exist before they connect
+    if (opts.shm) {
+        std::size_t slot_bytes = std::max<std::size_t>(MAX_FRAME_BYTES, FRAME_HEADER_BYTES + frame_stride(m_max_channels));
+        if (m_ring.create(shm_name(opts.tcp_port), SHM_SLOTS, slot_bytes))
+            LOG(Info) << "Publishing telemetry in shared memory " << m_ring.name() << ".";
+        else
+            LOG(Warning) << "Failed to create shared memory " << shm_name(opts.tcp_port) << ". GUIs on this host will use UDP.";
+    }
+    // listen for GUIs (and loggers) that speak our protocol
+    Handshake hello;
+    hello.loop_rate  = loop_rate.as_hertz();
+    hello.decimation = opts.decimation;
     TcpListener listener;
-    listener.listen(SERVER_TCP, SERVER_IP);
-    if (listener.accept(tcp) != Socket::Done) {
-        LOG(Error) << "Failed to connect to GUI.";
-        return;
+    if (listener.listen(opts.tcp_port, opts.address) != Socket::Done) {
+        LOG(Error) << "Failed to listen for GUIs on port " << opts.tcp_port << ".";
+        return false;
     }
-    LOG(Info) << "Connected to GUI: " << tcp.get_remote_port() << "@" << tcp.get_remote_address();
-        // start the control thread
-    m_running = true;
-    m_ctrl_thread = std::thread(&IPendulum::ctrl_thread_func, this, loop_rate);
-    // listen for TCP messages from GUI
-    Packet packet;
-    while (m_running) {
-        packet;
-        auto status = tcp.receive(packet);
-        if (status == Socket::Disconnected) {
-            LOG(Info) << "GUI disconnected.";
-            m_running = false;
+    SocketSelector selector;
+    selector.add(listener);
+    // the controller starts once the first GUI connects
+    LOG(Info) << "Waiting for GUI to connect on port " << opts.tcp_port << " ...";
+    while (greeted_clients() == 0) {
+        if (!serve_clients(selector.wait(milliseconds(100)), listener, selector, hello, opts)) {
+            LOG(Error) << "Failed to connect to GUI.";
+            return false;
         }
-        else if (status == Socket::Done) {
-            int msg;
-            packet >> msg;
-            if (msg == Message::Ping) {
-                packet.clear();
-                {
-                    std::lock_guard<std::mutex> lock(m_mtx);
-                    packet << m_status;
-                }
-                // send logs
-                packet << remote_writer.logs.size();
-                for (int i = 0; i < remote_writer.logs.size(); ++i)
-                    packet << (int)remote_writer.logs[i].first << remote_writer.logs[i].second;
-                tcp.send(packet);
-                remote_writer.logs.clear();
-            }
-            else if (msg == Message::Enable) {
-                std::lock_guard<std::mutex> lock(m_mtx);
-                m_status.enabled = true;
-                LOG(Info) << "Enabling pendulum.";
-            }
-            else if (msg == Message::Disable) {
-                std::lock_guard<std::mutex> lock(m_mtx);
-                m_status.enabled = false;
-                LOG(Info) << "Disabling pendulum.";
-            }
-            else if (msg == Message::Feedback) {
-                std::lock_guard<std::mutex> lock(m_mtx);
-                m_status.mode = m_status.mode == (int)Mode::Encoder ? (int)Mode::Midori : (int)Mode::Encoder;
-                LOG(Info) << "Changing pendulum feedback mode to " << (m_status.mode == (int)Mode::Encoder ? "Encoder." : "Midori.");
-            }
-            else if (msg == Message::Zero) {
-                std::lock_guard<std::mutex> lock(m_mtx);
-                g_zero = true;
-                LOG(Info) << "Zeroing pendulum encoder.";
-            }
-            else if (msg == Message::Shutdown) {
-                LOG(Info) << "Shutting down pendulum controller.";
-                m_running = false;
+    }
+    // fall back to the I/O backend this executable was built for
+    if (!m_hardware) {
+#ifdef PENDULUM_SIM
+        m_hardware.reset(new SimHardware());
+#else
+        m_hardware.reset(new MyRioHardware());
+#endif
+    }
+    if (opts.batch > 1 || opts.decimation > 1)
+        LOG(Info) << "Streaming every " << opts.decimation << " tick(s)" << (opts.decimation > 1 && opts.antialias ? " low-pass filtered" : "")
+                  << " in batches of " << opts.batch << ".";
+    // preallocate the telemetry queue before any thread touches it
+    m_samples.reset(new SampleQueue(opts.queue, m_max_channels));
+    // lock and prefault memory before the threads start, so their stacks are locked too
+    m_realtime = 0;
+    if (opts.mlock) {
+        if (lock_memory())
+            m_realtime |= RtLocked;
+        else
+            LOG(Warning) << "Failed to lock memory. Run as root or raise the memlock limit.";
+    }
+    if (opts.prefault && !prefault_heap(PREFAULT_HEAP))
+        LOG(Warning) << "Failed to prefault the heap.";
+    // the main thread serves the TCP clients
+    if (opts.net_cpu >= 0 && !set_thread_cpu(opts.net_cpu))
+        LOG(Warning) << "Failed to pin the network thread to CPU " << opts.net_cpu << ".";
+    // start the control and telemetry threads
+    m_io_failed = false;
+    m_running   = true;
+    m_ctrl_thread  = std::thread(&IPendulum::ctrl_thread_func, this, loop_rate, opts);
+    m_telem_thread = std::thread(&IPendulum::telem_thread_func, this, opts);
+    // serve every client, waking only when one sends something or pushes are due
+    Time push_period = seconds(1.0 / opts.status_rate);
+    Clock push_clock;
+    while (m_running) {
+        bool subscribed = false;
+        for (auto& client : m_clients)
+            subscribed |= client->subscribed;
+        // a zero wait would never time out
+        Time wait = milliseconds(100);
+        if (subscribed)
+            wait = std::max(push_period - push_clock.get_elapsed_time(), microseconds(1));
+        bool ready = selector.wait(wait);
+        if (subscribed && push_clock.get_elapsed_time() >= push_period) {
+            push_clock.restart();
+            // every subscriber gets the same snapshot and log records, with the same sequence numbers
+            drain_logs();
+            std::uint32_t seq = ++m_status_seq;
+            Status status = m_status.load();
+            for (auto& client : m_clients) {
+                if (client->subscribed && (!send_status(*client, seq, status) || !send_logs(*client)))
+                    client->closed = true;
             }
         }
-        else {
-            LOG(Error) << "Unexpected error!";
+        if (!serve_clients(ready, listener, selector, hello, opts))
+            LOG(Error) << "Failed to connect to GUI.";
+        // channels can be registered on the control thread, which doesn't log them
+        for (int channels = m_channels.load(std::memory_order_acquire); m_channels_logged < channels; ++m_channels_logged)
+            LOG(Verbose) << "Registered plot channel " << m_channels_logged << " \"" << m_labels[m_channels_logged] << "\".";
+        if (greeted_clients() == 0) {
+            LOG(Info) << "Every GUI disconnected.";
             m_running = false;
         }
     }
     m_ctrl_thread.join();
-    tcp.disconnect();
+    m_telem_thread.join();
+    for (auto& client : m_clients)
+        client->closed = true;
+    remove_clients(selector);
+    listener.close();
+    m_ring.close();
+    return !m_io_failed;
+}
+
+bool IPendulum::serve_clients(bool ready, TcpListener& listener, SocketSelector& selector, const Handshake& hello, const RunOptions& options) {
+    bool ok = true;
+    if (ready) {
+        if (selector.is_ready(listener))
+            ok = accept_client(listener, selector, options);
+        Packet packet;
+        for (auto& client : m_clients) {
+            if (client->closed || !selector.is_ready(client->tcp))
+                continue;
+            packet.clear();
+            if (client->tcp.receive(packet) != Socket::Done)
+                client->closed = true;
+            else if (client->greeted)
+                handle_message(*client, packet);
+            else if (!greet(*client, packet, hello))
+                client->closed = true;
+        }
+    }
+    // a client that connects and says nothing (a port probe, a stale GUI) is dropped, not waited on
+    for (auto& client : m_clients) {
+        if (!client->greeted && !client->closed && client->age.get_elapsed_time() > seconds(HELLO_TIMEOUT)) {
+            LOG(Warning) << "GUI " << client->tcp.get_remote_port() << "@" << client->address << " did not send a handshake in time.";
+            client->closed = true;
+        }
+    }
+    remove_clients(selector);
+    return ok;
+}
+
+int IPendulum::greeted_clients() const {
+    int greeted = 0;
+    for (auto& client : m_clients)
+        greeted += client->greeted;
+    return greeted;
+}
+
+bool IPendulum::greet(Client& client, Packet& packet, const Handshake& hello) {
+    if (!handshake(client.tcp, packet, hello, client.udp_port))
+        return false;
+    if (client.udp_port == 0) {
+        if (m_ring.is_open())
+            LOG(Info) << "GUI reads telemetry from shared memory " << m_ring.name() << ".";
+        else
+            LOG(Warning) << "GUI asked for shared memory telemetry, but it is off. Run with --shm.";
+    }
+    // replay recent logs so every GUI sees the same history
+    client.log_seq = m_log_seq - (std::uint32_t)m_log_history.size();
+    client.greeted = true;
+    std::lock_guard<std::mutex> lock(m_endpoints_mtx);
+    m_endpoints.push_back(Endpoint{client.address, client.udp_port});
+    return true;
+}
+
+bool IPendulum::accept_client(TcpListener& listener, SocketSelector& selector, const RunOptions& options) {
+    std::unique_ptr<Client> client(new Client());
+    if (listener.accept(client->tcp) != Socket::Done)
+        return false;
+    client->address = client->tcp.get_remote_address();
+    LOG(Info) << "Connected to GUI: " << client->tcp.get_remote_port() << "@" << client->address;
+    if ((int)m_clients.size() >= options.clients) {
+        LOG(Warning) << "Refusing GUI because " << options.clients << " are already connected.";
+        client->tcp.disconnect();
+        return true;
+    }
+    // it is served like any other client and answered once its Message::Hello arrives
+    selector.add(client->tcp);
+    m_clients.push_back(std::move(client));
+    return true;
+}
+
+void IPendulum::remove_clients(SocketSelector& selector) {
+    bool removed = false;
+    for (auto it = m_clients.begin(); it != m_clients.end();) {
+        if ((*it)->closed) {
+            LOG(Info) << "GUI " << (*it)->tcp.get_remote_port() << "@" << (*it)->address << " disconnected.";
+            selector.remove((*it)->tcp);
+            (*it)->tcp.disconnect();
+            it = m_clients.erase(it);
+            removed = true;
+        }
+        else {
+            ++it;
+        }
+    }
+    if (removed) {
+        std::lock_guard<std::mutex> lock(m_endpoints_mtx);
+        m_endpoints.clear();
+        for (auto& client : m_clients) {
+            if (client->greeted)
+                m_endpoints.push_back(Endpoint{client->address, client->udp_port});
+        }
+    }
+}
+
+void IPendulum::handle_message(Client& client, Packet& packet) {
+    int msg;
+    packet >> msg;
+    if (msg == Message::Ping) {
+        drain_logs();
+        // a reply isn't a push, so it repeats the latest push's number rather than taking one
+        send_status(client, m_status_seq, m_status.load());
+        send_logs(client);
+    }
+    else if (msg == Message::Subscribe) {
+        client.subscribed = true;
+        drain_logs();
+        send_status(client, m_status_seq, m_status.load());
+        send_logs(client);
+        LOG(Verbose) << "Pushing status to GUI " << client.tcp.get_remote_port() << "@" << client.address << ".";
+    }
+    else if (msg == Message::Enable) {
+        m_enabled = true;
+        LOG(Info) << "Enabling pendulum.";
+    }
+    else if (msg == Message::Disable) {
+        m_enabled = false;
+        LOG(Info) << "Disabling pendulum.";
+    }
+    else if (msg == Message::Feedback) {
+        int mode = m_mode == (int)Mode::Encoder ? (int)Mode::Midori : (int)Mode::Encoder;
+        m_mode = mode;
+        LOG(Info) << "Changing pendulum feedback mode to " << (mode == (int)Mode::Encoder ? "Encoder." : "Midori.");
+    }
+    else if (msg == Message::Zero) {
+        m_zero = true;
+        LOG(Info) << "Zeroing pendulum encoder.";
+    }
+    else if (msg == Message::Channels) {
+        // reply with the labels of every channel the GUI doesn't know yet
+        int first;
+        packet >> first;
+        packet.clear();
+        int channels = m_channels.load(std::memory_order_acquire);
+        if (first < 0 || first > channels)
+            first = 0;
+        packet << (int)Message::Channels << first << channels - first;
+        for (int i = first; i < channels; ++i)
+            packet << m_labels[i];
+        client.tcp.send(packet);
+    }
+    else if (msg == Message::Shutdown) {
+        LOG(Info) << "Shutting down pendulum controller.";
+        m_running = false;
+    }
+}
+
+void IPendulum::drain_logs() {
+    // formatting is deferred until now
+    auto keep = [this](Severity severity, const std::string& text) {
+        m_log_history.push_back(std::make_pair(severity, text));
+        if (m_log_history.size() > LOG_HISTORY)
+            m_log_history.pop_front();
+        m_log_seq++;
+    };
+    LogEntry entry;
+    while (remote_log().pop(entry))
+        keep(entry.severity, RemoteLog::format(entry));
+    int dropped = remote_log().take_dropped();
+    if (dropped > 0)
+        keep(Warning, fmt::format("{} log record(s) dropped because the log was full\n", dropped));
+}
+
+bool IPendulum::send_status(Client& client, std::uint32_t seq, const Status& status) {
+    Packet packet;
+    packet << (int)Message::Update << seq << status;
+    return client.tcp.send(packet) == Socket::Done;
+}
+
+bool IPendulum::send_logs(Client& client) {
+    // a client that fell behind the history skips ahead (the gap shows in the sequence numbers)
+    std::uint32_t first = m_log_seq - (std::uint32_t)m_log_history.size();
+    if ((std::int32_t)(client.log_seq - first) < 0)
+        client.log_seq = first;
+    std::size_t count = m_log_seq - client.log_seq;
+    if (count == 0)
+        return true;
+    Packet packet;
+    packet << (int)Message::Logs << client.log_seq << (int)count;
+    for (std::size_t i = m_log_history.size() - count; i < m_log_history.size(); ++i)
+        packet << (int)m_log_history[i].first << m_log_history[i].second;
+    client.log_seq = m_log_seq;
+    return client.tcp.send(packet) == Socket::Done;
+}
+
+RunOptions parse_run_options(int argc, char const *argv[]) {
+    RunOptions options;
+    for (int i = 1; i < argc; ++i) {
+        bool value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--address") && value)
+            options.address = argv[++i];
+        else if (!std::strcmp(argv[i], "--port") && value) {
+            options.tcp_port = (unsigned short)std::atoi(argv[++i]);
+            options.udp_port = (unsigned short)(options.tcp_port + 1);
+        }
+        else if (!std::strcmp(argv[i], "--priority") && value)
+            options.priority = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--ctrl-cpu") && value)
+            options.ctrl_cpu = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--net-cpu") && value)
+            options.net_cpu = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--mlock"))
+            options.mlock = true;
+        else if (!std::strcmp(argv[i], "--prefault"))
+            options.prefault = true;
+        else if (!std::strcmp(argv[i], "--telemetry-rate") && value)
+            options.telemetry_rate = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--decimation") && value) {
+            // a decimation only applies without a telemetry rate
+            options.decimation     = std::atoi(argv[++i]);
+            options.telemetry_rate = 0;
+        }
+        else if (!std::strcmp(argv[i], "--batch") && value)
+            options.batch = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--shm"))
+            options.shm = true;
+        else if (!std::strcmp(argv[i], "--replay") && value)
+            options.replay = argv[++i];
+        else if (!std::strcmp(argv[i], "--replay-out") && value)
+            options.replay_out = argv[++i];
+        else if (!std::strcmp(argv[i], "--mode") && value)
+            options.mode = std::strcmp(argv[++i], "midori") ? Mode::Encoder : Mode::Midori;
+        else if (!std::strcmp(argv[i], "--replay-tolerance") && value)
+            options.replay_tolerance = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sweep") && value)
+            options.sweep.push_back(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sweep-out") && value)
+            options.sweep_out = argv[++i];
+        else if (!std::strcmp(argv[i], "--sweep-time") && value)
+            options.sweep_time = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sweep-angle") && value)
+            options.sweep_angle = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sweep-threads") && value)
+            options.sweep_threads = (unsigned int)std::atoi(argv[++i]);
+        else
+            LOG(Warning) << "Ignoring unrecognized argument \"" << argv[i] << "\"" << (value ? "" : " (or it is missing its value)") << ".";
+    }
+    return options;
+}
+
+PlotChannel IPendulum::channel(const std::string& label) {
+    int id = channel_id(label);
+    if (id == -1)
+        return PlotChannel();
+    return PlotChannel(&m_values[id], id);
 }
 
 void IPendulum::plot(const std::string& label, double value) {
@@ -154,99 +467,211 @@ void IPendulum::plot(const std::string& label, double value) {
         LOG(Warning) << "Plots can only be called when the controller is running!";
         return;
     }
-    if (m_plots.size() < 5)
-        m_plots.push_back({label,value});
+    int id = channel_id(label);
+    if (id != -1)
+        m_values[id] = value;
+}
+
+void IPendulum::plot(const char* label, double value) {
+    if (!m_running) {
+        LOG(Warning) << "Plots can only be called when the controller is running!";
+        return;
+    }
+    // keyed by the literal's address, so only its first call touches the string
+    auto it = m_literal_ids.find(label);
+    if (it == m_literal_ids.end())
+        it = m_literal_ids.emplace(label, channel_id(label)).first;
+    if (it->second != -1)
+        m_values[it->second] = value;
+}
+
+void IPendulum::condition(Input input, Frequency cutoff, int order) {
+    if (m_running) {
+        LOG(Warning) << "The conditioning stage can only be changed before the controller runs!";
+        return;
+    }
+    m_conditioner.set_lowpass(input, cutoff.as_hertz(), order);
+}
+
+void IPendulum::gain(const std::string& name, double& value) {
+    m_gains[name] = &value;
+}
+
+bool IPendulum::set_gain(const std::string& name, double value) {
+    auto it = m_gains.find(name);
+    if (it == m_gains.end())
+        return false;
+    *it->second = value;
+    return true;
+}
+
+bool IPendulum::simulate(Frequency loop_rate, int ticks, Mode mode, IHardware& hw, const std::function<void(const State&)>& observe) {
+    if (m_running) {
+        LOG(Warning) << "The pendulum controller is already running!";
+        return false;
+    }
+    if (ticks < 1 || !hw.open(loop_rate))
+        return false;
+    // the live loop, stepping every tick with nothing streamed
+    RunOptions options;
+    options.decimation = 1;
+    options.antialias  = false;
+    m_mode    = (int)mode;
+    m_enabled = true;
+    m_running = true;
+    int last = -1;
+    auto publish = [&](const State& state, const double* values, int channels) {
+        observe(state);
+        last = state.tick;
+        if (last + 1 >= ticks)
+            m_running = false;
+        return true;
+    };
+    auto control = [this](Mode mode, double t, const Inputs& inputs) { return this->control(mode, t, inputs); };
+    run_loop<FreeRunTimer>(loop_rate, options, 0, control, hw, publish);
+    m_running = false;
+    m_enabled = false;
+    hw.close();
+    return last + 1 == ticks;
+}
+
+int IPendulum::channel_id(const std::string& label) {
+    auto it = m_label_ids.find(label);
+    if (it != m_label_ids.end())
+        return it->second;
+    // first time we've seen this label, so register it for the GUI
+    int id = m_channels.load(std::memory_order_relaxed);
+    if (id == m_max_channels) {
+        // this can run on the control thread, so log once and without allocating
+        if (!m_overflowed) {
+            RT_LOG(Warning, "Too many plot channels! Only the first {} are plotted.", m_max_channels);
+            m_overflowed = true;
+        }
+        return -1;
+    }
+    // publish the label before the count so the main thread never reads a partial label
+    m_labels[id] = label;
+    m_label_ids[label] = id;
+    m_channels.store(id + 1, std::memory_order_release);
+    return id;
 }
 
-void IPendulum::ctrl_thread_func(Frequency loop_rate) {
+void IPendulum::ctrl_thread_func(Frequency loop_rate, RunOptions options) {
     LOG(Info) << "Starting pendulum control thread.";
+    // initialize I/O
+    IHardware& hw = *m_hardware;
+    // tell the telemetry thread to stop once it has drained the queue
+    auto stop_telemetry = [this]() {
+        State state;
+        state.tick = -1;
+        while (!m_samples->try_push(state, nullptr, 0))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        m_samples_ready.ring();
+    };
+    if (!hw.open(loop_rate)) {
+        // never drive hardware that didn't open
+        LOG(Error) << "Failed to open " << hw.name() << " I/O.";
+        m_io_failed = true;
+        m_running   = false;
+        stop_telemetry();
+        return;
+    }
+    LOG(Info) << "Opened " << hw.name() << " I/O.";
+    // real-time setup, last so the hardware's own threads keep default scheduling
+    int realtime = m_realtime;
+    if (options.ctrl_cpu >= 0) {
+        if (set_thread_cpu(options.ctrl_cpu))
+            realtime |= RtPinned;
+        else
+            LOG(Warning) << "Failed to pin the control thread to CPU " << options.ctrl_cpu << ".";
+    }
+    if (options.priority > 0) {
+        if (set_thread_priority(options.priority))
+            realtime |= RtFifo;
+        else
+            LOG(Warning) << "Failed to run the control thread at SCHED_FIFO priority " << options.priority << ". Run as root or grant CAP_SYS_NICE.";
+    }
+    if (options.prefault) {
+        prefault_stack(PREFAULT_STACK);
+        realtime |= RtPrefault;
+    }
+    if (realtime)
+        LOG(Info) << "Control thread real-time settings:" << (realtime & RtFifo ? " SCHED_FIFO" : "") << (realtime & RtPinned ? " pinned" : "")
+                  << (realtime & RtLocked ? " mlock" : "") << (realtime & RtPrefault ? " prefault" : "") << ".";
+    control_loop(loop_rate, options, realtime);
+    hw.close();
+    stop_telemetry();
+    LOG(Info) << "Terminated pendulum control thread.";
+}
+
+void IPendulum::control_loop(Frequency loop_rate, const RunOptions& options, int realtime) {
+    auto control = [this](Mode mode, double t, const Inputs& inputs) { return this->control(mode, t, inputs); };
+    run_loop(loop_rate, options, realtime, control, *m_hardware);
+}
+
+double IPendulum::control(Mode mode, double t, const Inputs& inputs) {
+    if (mode == Mode::Encoder)
+        return control_encoder(t, inputs.encoder);
+    return control_midori(t, inputs.midori);
+}
+
+void IPendulum::telem_thread_func(RunOptions options) {
+    LOG(Info) << "Starting pendulum telemetry thread.";
+    if (options.net_cpu >= 0 && !set_thread_cpu(options.net_cpu))
+        LOG(Warning) << "Failed to pin the telemetry thread to CPU " << options.net_cpu << ".";
     // initialize UDP stream
     UdpSocket udp;
-    auto result = udp.bind(SERVER_UDP);
+    auto result = udp.bind(options.udp_port);
     if (result == Socket::Done)
         LOG(Info) << "Opened UPD socket on port " << udp.get_local_port() << ".";
     else
         LOG(Error) << "Failed to open UDP socket on port " << udp.get_local_port() << ".";
-    State state;
-    Packet packet;
-    Data data;
-    m_plots.reserve(10);
-    // initialize myRIO       
-    MyRio myrio;
-    myrio.mspC.encoder.set_channels({0});
-    myrio.mspC.encoder.units[0] = 2 * PI / 500.0;
-    myrio.mspC.encoder.zero(0);
-    myrio.mspC.DO.set_channels({1});
-    myrio.enable();
-    // timing
-    Timer timer(loop_rate);
-    RateMonitor monitor;
-    // start the control loop
-    while (m_running) {
-        Mode mode;
-        char enabled;
-        // update status
-        {
-            std::lock_guard<std::mutex> lock(m_mtx);
-            m_status.running   = m_running;
-            m_status.frequency = monitor.rate();
-            m_status.misses    = (int)timer.get_misses();
-            m_status.wait      = timer.get_wait_ratio();
-            mode               = (Mode)m_status.mode;
-            enabled            = m_status.enabled;
-        }
-        // check for encoder zero
-        if (g_zero) {
-            std::lock_guard<std::mutex> lock(m_mtx);
-            myrio.mspC.encoder.zero(0);
-            g_zero = false;
-        }
-        if (myrio.mspC.encoder.has_encoder_error({0})){
-            myrio.mspC.encoder.clear_encoder_error({0});
-            LOG(Verbose) << "Clearing encoder error";
-        }
-        // read inputs
-        myrio.read_all();
-        state.tick    = timer.get_elapsed_ticks();
-        state.time    = timer.get_elapsed_time_ideal().as_seconds();
-        state.sense   = myrio.mspC.AI[0];
-        state.midori  = myrio.mspC.AI[1];
-        state.encoder = myrio.mspC.encoder[0];
-        state.enable  = enabled;
-        if (mode == Mode::Encoder)
-            state.command = control_encoder(state.time, state.encoder);
-        else if (mode == Mode::Midori)
-            state.command = control_midori(state.time, state.midori);
-        myrio.mspC.AO[0] = enabled ? state.command : 0;
-        myrio.mspC.DO[1] = enabled;
-        for (int l = 0; l < 4; ++l)
-            myrio.LED[l] = enabled;
-        myrio.write_all();
-        // stream data
-        packet.clear();
-        data.state = state;
-        data.plots = m_plots;
-        packet << data;
-        udp.send(packet, CLIENT_IP, CLIENT_UDP);     
-        m_plots.clear();         
-        if (g_stop)
-            m_running = false;
-        monitor.tick();
-        monitor.update(timer.get_elapsed_time());
-        timer.wait();
-    }   
-    myrio.mspC.AO[0] = 0;
-    myrio.mspC.DO[1] = TTL_LOW;
-    for (int l = 0; l < 4; ++l)
-        myrio.LED[l] = TTL_LOW;
-    myrio.write_all();
-    state.tick = -1;
-    data.state = state;
-    data.plots.clear();
-    packet.clear();
-    packet << data;
-    udp.send(packet, CLIENT_IP, CLIENT_UDP);
-    myrio.disable();
-    myrio.close();
-    LOG(Info) << "Terminated pendulum control thread.";
-}
\ No newline at end of file
+    // frames are built in place in a preallocated buffer
+    FrameWriter frame(MAX_FRAME_BYTES, m_max_channels);
+    auto send = [&]() {
+        frame.finish();
+        // each frame is built once and sent to every client, except those reading shared memory (port 0)
+        if (m_ring.is_open())
+            m_ring.publish(frame.data(), frame.size());
+        std::lock_guard<std::mutex> lock(m_endpoints_mtx);
+        for (auto& endpoint : m_endpoints) {
+            if (endpoint.port)
+                udp.send(frame.data(), frame.size(), endpoint.address, endpoint.port);
+        }
+    };
+    int batched = 0;
+    bool stop = false;
+    while (!stop) {
+        SampleView sample;
+        if (!m_samples->front(sample)) {
+            // sleep until the control thread queues a full batch (or the stop sample)
+            m_samples_ready.wait([&]() { return m_samples->front(sample); }, TELEMETRY_IDLE_WAKE);
+            continue;
+        }
+        if (sample.state->tick == -1) {
+            // flush the partial batch followed by the stop sample
+            if (batched > 0)
+                send();
+            frame.begin(0, options.decimation);
+            frame.append(*sample.state, nullptr);
+            send();
+            stop = true;
+        }
+        else {
+            // every sample in a frame has the same channels, so a new channel starts a new frame
+            if (batched > 0 && (sample.count != frame.channels() || !frame.fits())) {
+                send();
+                batched = 0;
+            }
+            if (batched == 0)
+                frame.begin(sample.count, options.decimation);
+            frame.append(*sample.state, sample.values);
+            if (++batched >= options.batch || !frame.fits()) {
+                send();
+                batched = 0;
+            }
+        }
+        m_samples->pop();
+    }
+    LOG(Info) << "Terminated pendulum telemetry thread.";
+}
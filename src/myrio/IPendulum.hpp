@@ -1,37 +1,229 @@
 #pragma once
 
 #include "common.hpp"     // for types needed to communicate with GUI
+#include "SeqLock.hpp"    // for SeqLock
+#include "IHardware.hpp"  // for IHardware
+#include "Conditioner.hpp" // for Conditioner, Conditioned
+#include "RemoteLog.hpp"  // for RT_LOG
+#include "SampleQueue.hpp" // for SampleQueue
+#include "Doorbell.hpp"    // for Doorbell
+#include "ShmRing.hpp"    // for ShmRing
 #include <Mahi/Robo.hpp>  // for Butterworth
 #include <thread>         // for std::thread
-#include <mutex>          // for std::mutex
 #include <atomic>         // for std::atomic_bool
+#include <unordered_map>  // for std::unordered_map
+#include <memory>         // for std::unique_ptr
+#include <cstdint>        // for std::uint32_t
+#include <deque>          // for std::deque
+#include <functional>     // for std::function
+#include <mutex>          // for std::mutex
+#include <string>         // for std::string
+#include <vector>         // for std::vector
 
 // so we can say foo() instead of mahi::daq::foo() etc.
 using namespace mahi::robo;
 using namespace mahi::util;
 
+/// Options for running the pendulum controller.
+struct RunOptions {
+    int batch      = 1;    ///< the number of streamed samples packed into each UDP datagram
+    int decimation = 1;    ///< stream only every Nth controller tick to the GUI (if telemetry_rate is 0)
+    double telemetry_rate   = 1000; ///< the rate samples are streamed [Hz], rounded to a whole decimation of the loop rate, or 0 to use decimation
+    bool   antialias        = true; ///< low-pass filter each signal before streaming every Nth tick, so faster content doesn't alias
+    double housekeeping_rate = 100; ///< the rate Status and the loop rate and timing statistics are updated [Hz]
+    int queue      = 2048; ///< the number of samples the telemetry queue holds before dropping
+    double status_rate = 30; ///< the rate Status and logs are pushed to a subscribed GUI [Hz]
+    std::string    address  = SERVER_IP;  ///< the address GUIs connect to
+    unsigned short tcp_port = SERVER_TCP; ///< the TCP port GUIs connect to
+    unsigned short udp_port = SERVER_UDP; ///< the UDP port telemetry is sent from
+    int            clients  = 8;          ///< the most GUIs (or loggers) connected at once
+    bool           shm      = false;      ///< also publish telemetry in shared memory for GUIs on this host (Linux only)
+    int  priority = 0;      ///< SCHED_FIFO priority of the control thread [1...99], or 0 for default scheduling
+    int  ctrl_cpu = -1;     ///< the CPU the control thread is pinned to, or -1 for any
+    int  net_cpu  = -1;     ///< the CPU the network (main) and telemetry threads are pinned to, or -1 for any
+    bool mlock    = false;  ///< lock the controller's memory in RAM so it is never paged out
+    bool prefault = false;  ///< touch the control thread's stack and the heap before the loop starts
+    int         mode = Encoder;           ///< the feedback Mode used offline by --replay and --sweep
+    std::string replay;                   ///< replay this session recording through the controller instead of running live
+    std::string replay_out;               ///< write the replayed command trace to this CSV file
+    double      replay_tolerance = 1e-9;  ///< the largest command difference counted as a match [V]
+    std::vector<std::string> sweep;       ///< gains to sweep against the simulator, each "name=from:to:count" or "name=v1,v2,..."
+    std::string  sweep_out;               ///< write the sweep results to this CSV file
+    double       sweep_time    = 5;       ///< the simulated duration of each sweep run [s]
+    double       sweep_angle   = 0.5;     ///< the pendulum angle each sweep run starts from [rad]
+    unsigned int sweep_threads = 0;       ///< the number of threads running the sweep, or 0 for every core
+};
+
+/// Reads RunOptions from the command line: --address ip and --port N (TCP
+/// port N, UDP port N+1), e.g. to run several simulated pendulums on one host,
+/// the real-time settings --priority P, --ctrl-cpu C, --net-cpu C, --mlock
+/// and --prefault, --telemetry-rate R (or --decimation N) and --batch N, --shm,
+/// --mode encoder|midori, --replay file.rec with --replay-out file.csv and
+/// --replay-tolerance V, and --sweep name=spec (repeatable) with --sweep-out
+/// file.csv, --sweep-time T, --sweep-angle A and --sweep-threads N.
+/// Unrecognized arguments are logged and ignored.
+RunOptions parse_run_options(int argc, char const *argv[]);
+
+class IPendulum;
+
+/// Runs options.sweep's grid of gains in parallel, each combination in its own
+/// pendulum from make() closed around the simulated plant, and reports the
+/// settling time, overshoot, RMS command and saturation time of each. Only
+/// PENDULUM_SIM builds have the plant. Returns false if the sweep couldn't run.
+bool sweep(Frequency loop_rate, const RunOptions& options, const std::function<IPendulum*()>& make);
+
+/// The default maximum number of distinct plot channels.
+#define MAX_CHANNELS 32
+/// The number of recent remote log records replayed to a GUI when it connects.
+#define LOG_HISTORY 500
+/// Seconds a newly connected client has to send Message::Hello before it is dropped.
+#define HELLO_TIMEOUT 1
+/// Milliseconds the idle telemetry thread sleeps before rechecking its queue if it isn't woken.
+#define TELEMETRY_IDLE_WAKE 100
+
+/// Handle to a plot channel registered with IPendulum::channel(...). Declare it
+/// once and set it every tick; setting is a single store with no string work.
+class PlotChannel {
+public:
+    /// Constructs a handle that plots nothing.
+    PlotChannel() : m_value(nullptr), m_id(-1) { }
+    /// Plot a value to the pendulum GUI this tick.
+    void set(double value) const { if (m_value) *m_value = value; }
+    /// Returns the channel ID, or -1 if the channel could not be registered.
+    int id() const { return m_id; }
+private:
+    friend class IPendulum;
+    PlotChannel(double* value, int id) : m_value(value), m_id(id) { }
+    double* m_value; // slot in IPendulum's channel values
+    int     m_id;    // channel ID
+};
+
 /// Pendulum interface. Abstract base class.
 class IPendulum  {
 public:
-    /// Constructor.
-    IPendulum();
+    /// Constructor. Uses the myRIO (or the simulator in PENDULUM_SIM builds) if no I/O backend is given.
+    IPendulum(std::unique_ptr<IHardware> hardware = nullptr, int max_channels = MAX_CHANNELS);
     /// Destructor.
     virtual ~IPendulum();
-    /// Run the pendulum interface at a desired loop rate.
-    void run(Frequency loop_rate = 1000_Hz);
-    /// Plot a value to the pendulum GUI.
+    /// Run the pendulum interface at a desired loop rate, or replay a recording if options.replay is set.
+    /// Returns false if the controller or its I/O failed to start or the replay didn't match.
+    bool run(Frequency loop_rate = 1000_Hz, const RunOptions& options = RunOptions());
+    /// Feeds a session recording through the controller as fast as possible, without hardware, timers
+    /// or sockets, and compares its commands to the recorded ones. Returns true if they all match.
+    bool replay(const std::string& path, const RunOptions& options = RunOptions());
+    /// Registers a plot channel (or finds an existing one) and returns a handle to it.
+    PlotChannel channel(const std::string& label);
+    /// Plot a value to the pendulum GUI. This is the slow compatibility path: it hashes the label
+    /// every call. Prefer channel(...) handles in control loops.
     void plot(const std::string& label, double value);
+    /// Plot a value to the pendulum GUI under a string literal, looked up by its address so only
+    /// the first call does string work. The label must outlive the pendulum and never change.
+    void plot(const char* label, double value);
+    /// Low-pass filters an input in the conditioning stage, which runs every tick before control. Call before run().
+    void condition(Input input, Frequency cutoff, int order = 2);
+    /// This tick's inputs after the conditioning stage: filtered, and their derivatives.
+    const Conditioned& conditioned() const { return m_conditioner.output(); }
+    /// Registers a controller gain (a member that outlives the pendulum) by name, so a sweep can set it.
+    void gain(const std::string& name, double& value);
+    /// Sets a gain registered with gain(...). Returns false if there is none by that name.
+    bool set_gain(const std::string& name, double value);
+    /// Runs the control loop for ticks ticks against hw on the calling thread, as fast as possible
+    /// with the amplifier enabled and no telemetry, calling observe(state) after each tick.
+    /// Returns false if it couldn't run or was stopped.
+    bool simulate(Frequency loop_rate, int ticks, Mode mode, IHardware& hw, const std::function<void(const State&)>& observe);
     /// Interface to implement control with encoder position feedback.
     virtual double control_encoder(double t, int counts) = 0;
     /// Interface to implement control with Midori potentiometer position feedback.
     virtual double control_midori(double t, double midori_volts) = 0;
+protected:
+    /// Runs the control loop on the control thread until the controller stops,
+    /// calling the controller through the vtable. PendulumRunner overrides it to
+    /// bind the controller and I/O backend at compile time.
+    virtual void control_loop(Frequency loop_rate, const RunOptions& options, int realtime);
+    /// The control loop, where control(mode, t, inputs) returns the command and
+    /// hw does the I/O, streaming to the telemetry thread. Defined in ControlLoop.hpp.
+    template <class Control, class Hardware>
+    void run_loop(Frequency loop_rate, const RunOptions& options, int realtime, Control control, Hardware& hw);
+    /// The control loop paced by Pacer (Timer or FreeRunTimer), handing each
+    /// streamed sample to publish(state, values, channels), which returns false
+    /// if it was dropped.
+    template <class Pacer, class Control, class Hardware, class Publish>
+    void run_loop(Frequency loop_rate, const RunOptions& options, int realtime, Control control, Hardware& hw, Publish publish);
+    /// The I/O backend (only valid once run() has started the control thread).
+    IHardware& hardware() { return *m_hardware; }
 private:
     /// The function that will by run by the control thread.
-    void ctrl_thread_func(Frequency loop_rate);
+    void ctrl_thread_func(Frequency loop_rate, RunOptions options);
+    /// The function that will be run by the telemetry thread.
+    void telem_thread_func(RunOptions options);
+    /// Calls the controller for mode through the vtable.
+    double control(Mode mode, double t, const Inputs& inputs);
+    /// Returns the channel ID for a plot label, registering it if it is new.
+    int channel_id(const std::string& label);
+    /// A GUI (or logger) connected to the controller.
+    struct Client {
+        TcpSocket      tcp;                // control channel
+        IpAddress      address;            // where telemetry is sent
+        unsigned short udp_port   = 0;     // where telemetry is sent
+        bool           subscribed = false; // push Status and logs to it?
+        std::uint32_t  log_seq    = 0;     // sequence number of the next log record to send it
+        bool           closed     = false; // disconnected, so remove it
+        bool           greeted    = false; // has completed the Message::Hello handshake
+        Clock          age;                // time since it connected
+    };
+    /// Where the telemetry thread sends frames.
+    struct Endpoint {
+        IpAddress      address;
+        unsigned short port;
+    };
+    /// Accepts new clients if ready, handles every message waiting, and drops clients that haven't
+    /// completed the handshake within HELLO_TIMEOUT. Never waits on a client. Returns false if the listener failed.
+    bool serve_clients(bool ready, TcpListener& listener, SocketSelector& selector, const Handshake& hello, const RunOptions& options);
+    /// The number of clients that have completed the handshake.
+    int greeted_clients() const;
+    /// Answers a client's first message. Returns false if it isn't a Message::Hello in our protocol.
+    bool greet(Client& client, Packet& packet, const Handshake& hello);
+    /// Accepts a client waiting on the listener. Returns false if the listener failed.
+    bool accept_client(TcpListener& listener, SocketSelector& selector, const RunOptions& options);
+    /// Removes closed clients and updates the telemetry endpoints.
+    void remove_clients(SocketSelector& selector);
+    /// Handles one message from a client.
+    void handle_message(Client& client, Packet& packet);
+    /// Moves records from the remote log to the log history.
+    void drain_logs();
+    /// Sends a Status snapshot as a Message::Update.
+    bool send_status(Client& client, std::uint32_t seq, const Status& status);
+    /// Sends the log history the client hasn't seen as a Message::Logs, if there is any.
+    bool send_logs(Client& client);
 private:
+    std::unique_ptr<IHardware> m_hardware; // the I/O backend used by the control thread
     std::thread       m_ctrl_thread;  // thread that will run the controller
-    std::mutex        m_mtx;          // mutex that will protect state shared by control and main thread
+    std::thread       m_telem_thread; // thread that will stream samples to the GUI
+    std::unique_ptr<SampleQueue> m_samples; // samples queued by the control thread for the telemetry thread
+    Doorbell          m_samples_ready; // rung by the control thread once per batch of samples queued
+    ShmRing           m_ring;         // telemetry for GUIs on this host, if options.shm (telemetry thread)
     std::atomic_bool  m_running;      // is the controller running?
-    Status            m_status;       // cached controller status information
-    std::vector<Plot> m_plots;        // buffer of user plots added with plot(...)
+    std::atomic_bool  m_enabled;      // command: is the pendulum amplifier enabled? (written by main thread)
+    std::atomic_int   m_mode;         // command: which feedback mode are we in? (written by main thread)
+    std::atomic_bool  m_zero;         // command: zero the encoder on the next tick (cleared by control thread)
+    std::atomic_bool  m_io_failed;    // the control thread couldn't open the I/O backend
+    SeqLock<Status>   m_status;       // controller status published by the control thread
+    Conditioner       m_conditioner;  // conditioning stage (control thread once running)
+    int               m_realtime;     // RealTime settings applied by run() before the threads start
+    const int         m_max_channels; // capacity of m_values and m_labels
+    std::unique_ptr<double[]>      m_values;          // value of each channel this tick (NaN if not plotted)
+    std::unique_ptr<std::string[]> m_labels;          // plot labels indexed by channel ID (append only)
+    std::atomic_int   m_channels;     // number of labels published in m_labels
+    std::unordered_map<std::string, int> m_label_ids; // channel IDs keyed by plot label (registering thread only)
+    std::unordered_map<const char*, int> m_literal_ids; // channel IDs (or -1) keyed by label literal passed to plot (control thread)
+    int               m_channels_logged; // channels already reported in the log (main thread)
+    bool              m_overflowed;   // has running out of channels been logged?
+    std::unordered_map<std::string, double*> m_gains; // gains registered with gain(...), keyed by name
+    std::vector<std::unique_ptr<Client>> m_clients; // connected GUIs (main thread only)
+    std::vector<Endpoint> m_endpoints;     // telemetry destinations, one per client
+    std::mutex        m_endpoints_mtx;     // guards m_endpoints (main and telemetry threads)
+    std::deque<std::pair<Severity, std::string>> m_log_history; // recent remote log records, oldest first
+    std::uint32_t     m_status_seq;   // sequence number of the last pushed Status snapshot (0 before the first)
+    std::uint32_t     m_log_seq;      // sequence number of the next log record (one past the newest in m_log_history)
+    static std::atomic_bool s_stop;   // set when Ctrl-C is pressed
 };
\ No newline at end of file
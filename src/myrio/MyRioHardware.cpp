@@ -0,0 +1,50 @@
+#include "MyRioHardware.hpp"
+#include "RemoteLog.hpp"  // for RT_LOG
+
+using namespace mahi::daq;
+using namespace mahi::util;
+
+bool MyRioHardware::open(Frequency loop_rate) {
+    m_myrio.reset(new MyRio());
+    m_myrio->mspC.encoder.set_channels({0});
+    m_myrio->mspC.encoder.units[0] = 2 * PI / 500.0;
+    m_myrio->mspC.encoder.zero(0);
+    m_myrio->mspC.DO.set_channels({1});
+    return m_myrio->enable();
+}
+
+void MyRioHardware::close() {
+    if (!m_myrio)
+        return;
+    m_myrio->mspC.AO[0] = 0;
+    m_myrio->mspC.DO[1] = TTL_LOW;
+    for (int l = 0; l < 4; ++l)
+        m_myrio->LED[l] = TTL_LOW;
+    m_myrio->write_all();
+    m_myrio->disable();
+    m_myrio->close();
+    m_myrio.reset();
+}
+
+void MyRioHardware::read(Inputs& inputs) {
+    if (m_myrio->mspC.encoder.has_encoder_error({0})){
+        m_myrio->mspC.encoder.clear_encoder_error({0});
+        RT_LOG(Verbose, "Clearing encoder error");
+    }
+    m_myrio->read_all();
+    inputs.sense   = m_myrio->mspC.AI[0];
+    inputs.midori  = m_myrio->mspC.AI[1];
+    inputs.encoder = m_myrio->mspC.encoder[0];
+}
+
+void MyRioHardware::write(const Outputs& outputs) {
+    m_myrio->mspC.AO[0] = outputs.command;
+    m_myrio->mspC.DO[1] = outputs.enable;
+    for (int l = 0; l < 4; ++l)
+        m_myrio->LED[l] = outputs.enable;
+    m_myrio->write_all();
+}
+
+void MyRioHardware::zero_encoder() {
+    m_myrio->mspC.encoder.zero(0);
+}
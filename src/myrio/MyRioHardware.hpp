@@ -0,0 +1,18 @@
+#pragma once
+
+#include "IHardware.hpp"  // for IHardware
+#include <Mahi/Daq.hpp>   // for MyRio
+#include <memory>         // for std::unique_ptr
+
+/// Pendulum I/O through the myRIO MSP C connector.
+class MyRioHardware final : public IHardware {
+public:
+    bool open(mahi::util::Frequency loop_rate) override;
+    void close() override;
+    void read(Inputs& inputs) override;
+    void write(const Outputs& outputs) override;
+    void zero_encoder() override;
+    const char* name() const override { return "myRIO"; }
+private:
+    std::unique_ptr<mahi::daq::MyRio> m_myrio; // created in open() so it lives on the control thread
+};
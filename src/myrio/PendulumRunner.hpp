@@ -0,0 +1,47 @@
+#pragma once
+
+#include "IPendulum.hpp"    // for IPendulum
+#include "ControlLoop.hpp"  // for IPendulum::run_loop
+#include <memory>           // for std::unique_ptr
+#include <type_traits>      // for std::is_abstract
+
+/// Pendulum runtime with the controller bound at compile time. Derive your
+/// pendulum from PendulumRunner<MyPendulum> instead of IPendulum and implement
+/// control_encoder and control_midori as usual. The control loop then calls
+/// them directly instead of through the vtable, so they inline into the loop.
+///
+/// With the default Hardware, the I/O backend is chosen at run time as with
+/// IPendulum. Give a final backend class (e.g. SimHardware) to have its read
+/// and write inlined too; one is default constructed if none is passed in.
+template <class Pendulum, class Hardware = IHardware>
+class PendulumRunner : public IPendulum {
+public:
+    /// Constructor.
+    PendulumRunner(std::unique_ptr<Hardware> hardware = nullptr, int max_channels = MAX_CHANNELS) :
+        IPendulum(own(std::move(hardware), std::is_abstract<Hardware>()), max_channels)
+    { }
+
+protected:
+    void control_loop(Frequency loop_rate, const RunOptions& options, int realtime) override {
+        Pendulum& self = static_cast<Pendulum&>(*this);
+        // qualified calls skip the vtable
+        auto control = [&self](Mode mode, double t, const Inputs& inputs) {
+            if (mode == Mode::Encoder)
+                return self.Pendulum::control_encoder(t, inputs.encoder);
+            return self.Pendulum::control_midori(t, inputs.midori);
+        };
+        run_loop(loop_rate, options, realtime, control, static_cast<Hardware&>(hardware()));
+    }
+
+private:
+    /// Passes on an I/O backend chosen at run time (or nullptr for the default).
+    static std::unique_ptr<IHardware> own(std::unique_ptr<Hardware> hardware, std::true_type) {
+        return std::move(hardware);
+    }
+    /// Passes on a concrete I/O backend, constructing one if none was given.
+    static std::unique_ptr<IHardware> own(std::unique_ptr<Hardware> hardware, std::false_type) {
+        if (!hardware)
+            hardware.reset(new Hardware());
+        return std::move(hardware);
+    }
+};
@@ -0,0 +1,71 @@
+#include "Realtime.hpp"
+#ifdef __linux__
+#include <alloca.h>        // for alloca
+#include <malloc.h>        // for mallopt
+#include <pthread.h>       // for pthread_setschedparam, pthread_setaffinity_np
+#include <sched.h>         // for SCHED_FIFO, cpu_set_t
+#include <sys/mman.h>      // for mlockall
+#include <sys/resource.h>  // for getrusage
+#include <unistd.h>        // for sysconf
+#include <cstdlib>         // for std::malloc, std::free
+#include <cstring>         // for std::memset
+#endif
+
+#ifdef __linux__
+
+bool set_thread_priority(int priority) {
+    sched_param param{};
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+bool set_thread_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+bool lock_memory() {
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+void prefault_stack(std::size_t bytes) {
+    // a volatile write per page keeps the compiler from eliding the array
+    unsigned char* stack = (unsigned char*)alloca(bytes);
+    long page = sysconf(_SC_PAGESIZE);
+    for (std::size_t i = 0; i < bytes; i += (std::size_t)page)
+        ((volatile unsigned char*)stack)[i] = 0;
+}
+
+bool prefault_heap(std::size_t bytes) {
+    // keep freed memory in the heap instead of trimming or unmapping it
+    if (!mallopt(M_TRIM_THRESHOLD, -1) || !mallopt(M_MMAP_MAX, 0))
+        return false;
+    void* heap = std::malloc(bytes);
+    if (!heap)
+        return false;
+    std::memset(heap, 0, bytes);
+    std::free(heap);
+    return true;
+}
+
+long thread_page_faults() {
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0)
+        return -1;
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+#else
+
+bool set_thread_priority(int priority) { return false; }
+bool set_thread_cpu(int cpu) { return false; }
+bool lock_memory() { return false; }
+void prefault_stack(std::size_t bytes) { }
+bool prefault_heap(std::size_t bytes) { return false; }
+long thread_page_faults() { return -1; }
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>  // for std::size_t
+
+/// Bytes of control thread stack touched before the loop starts.
+#define PREFAULT_STACK (256 * 1024)
+/// Bytes of heap touched (and kept by the allocator) before the loop starts.
+#define PREFAULT_HEAP  (8 * 1024 * 1024)
+
+// Real-time setup of the calling thread or process. Everything here is only
+// implemented on Linux (including NI Linux RT); elsewhere each function does
+// nothing and reports failure, so the controller still runs with defaults.
+
+/// Runs the calling thread under SCHED_FIFO at priority [1...99]. Returns false if not permitted (needs root or CAP_SYS_NICE).
+bool set_thread_priority(int priority);
+/// Pins the calling thread to one CPU. Returns false if the CPU doesn't exist.
+bool set_thread_cpu(int cpu);
+/// Locks every current and future page of the process in RAM. Returns false if not permitted.
+bool lock_memory();
+/// Touches bytes of the calling thread's stack so its pages are mapped before they are needed.
+void prefault_stack(std::size_t bytes);
+/// Touches bytes of heap and stops the allocator returning memory to the OS,
+/// so later allocations reuse mapped pages. Returns false if unsupported.
+bool prefault_heap(std::size_t bytes);
+/// Returns the page faults (minor and major) taken by the calling thread so far, or -1 if unsupported.
+long thread_page_faults();
@@ -0,0 +1,31 @@
+#include "RemoteLog.hpp"
+#include <ctime>  // for std::localtime
+
+std::string RemoteLog::format(const LogEntry& entry) {
+    // LOG records were already formatted by the logger's formatter
+    if (entry.format == nullptr)
+        return entry.text;
+    static const char* names[] = {"NONE", "FATAL", "ERROR", "WARNING", "INFO", "VERBOSE", "DEBUG"};
+    const char* severity = (entry.severity >= 0 && entry.severity <= 6) ? names[entry.severity] : "";
+    // timestamp
+    std::time_t secs = (std::time_t)(entry.time / 1000000);
+    int millis = (int)((entry.time / 1000) % 1000);
+    std::tm t = *std::localtime(&secs);
+    // message
+    std::string message;
+    const double* a = entry.args;
+    try {
+        switch (entry.argc) {
+            case 0:  message = entry.format; break;
+            case 1:  message = fmt::vformat(entry.format, fmt::make_format_args(a[0])); break;
+            case 2:  message = fmt::vformat(entry.format, fmt::make_format_args(a[0], a[1])); break;
+            case 3:  message = fmt::vformat(entry.format, fmt::make_format_args(a[0], a[1], a[2])); break;
+            default: message = fmt::vformat(entry.format, fmt::make_format_args(a[0], a[1], a[2], a[3])); break;
+        }
+    }
+    catch (...) {
+        message = entry.format;
+    }
+    return fmt::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03} {:<7} {}\n", 
+                       t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, millis, severity, message);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "MpmcQueue.hpp"  // for MpmcQueue
+#include <Mahi/Util.hpp>  // for Severity
+#include <chrono>         // for std::chrono::system_clock
+#include <cstdint>        // for std::int64_t
+#include <cstring>        // for std::memcpy
+#include <atomic>         // for std::atomic_int
+
+/// The maximum number of arguments stored with a deferred log record.
+#define LOG_ARGS 4
+/// The maximum length of a preformatted log message.
+#define LOG_TEXT 160
+
+/// Compact binary log record. Records made with RT_LOG store a pointer to 
+/// their static format string (which doubles as its format ID) and numeric 
+/// arguments, so formatting happens later on the thread that drains the log.
+struct LogEntry {
+    mahi::util::Severity severity;  ///< the log severity
+    std::int64_t         time;      ///< wall clock time the record was made [us since epoch]
+    const char*          format;    ///< static format string, or nullptr if text holds the message
+    int                  argc;      ///< the number of valid entries in args
+    double               args[LOG_ARGS]; ///< the format arguments
+    char                 text[LOG_TEXT]; ///< the preformatted message if format is nullptr
+};
+
+/// Preallocated lock-free log sink that the GUI's Remote Logs are drained 
+/// from. Writing is bounded-time and safe from any thread, including the 
+/// control thread; records are dropped (and counted) if the sink is full.
+class RemoteLog {
+public:
+    /// Constructor.
+    RemoteLog(std::size_t capacity = 256) : m_queue(capacity), m_dropped(0) { }
+
+    /// Queues a record whose fmt style format string is formatted when drained.
+    /// The format string must outlive the record (i.e. be a string literal).
+    template <typename... Args>
+    void log(mahi::util::Severity severity, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= LOG_ARGS, "too many RT_LOG arguments");
+        LogEntry entry;
+        entry.severity = severity;
+        entry.time     = now();
+        entry.format   = format;
+        entry.argc     = (int)sizeof...(Args);
+        double values[] = { 0.0, (double)args... };
+        std::memcpy(entry.args, values + 1, sizeof...(Args) * sizeof(double));
+        push(entry);
+    }
+
+    /// Queues an already formatted message, truncated to LOG_TEXT - 1 characters.
+    void log_text(mahi::util::Severity severity, const std::string& text) {
+        LogEntry entry;
+        entry.severity = severity;
+        entry.time     = now();
+        entry.format   = nullptr;
+        entry.argc     = 0;
+        std::size_t n  = text.size() < LOG_TEXT - 1 ? text.size() : LOG_TEXT - 1;
+        std::memcpy(entry.text, text.data(), n);
+        entry.text[n] = '\0';
+        push(entry);
+    }
+
+    /// Pops the oldest record into entry. Returns false if there are none.
+    bool pop(LogEntry& entry) { return m_queue.try_pop(entry); }
+
+    /// Returns and resets the number of records dropped because the sink was full.
+    int take_dropped() { return m_dropped.exchange(0); }
+
+    /// Formats a record the way the console log would show it.
+    static std::string format(const LogEntry& entry);
+
+private:
+    static std::int64_t now() {
+        auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count();
+    }
+
+    void push(const LogEntry& entry) {
+        if (!m_queue.try_push(entry))
+            m_dropped++;
+    }
+
+    MpmcQueue<LogEntry> m_queue;   // preallocated records
+    std::atomic_int     m_dropped; // records lost to a full queue
+};
+
+/// The log drained into the GUI's Remote Logs.
+RemoteLog& remote_log();
+
+/// Bounded-time, allocation-free logging for the control thread, e.g.
+/// RT_LOG(Warning, "Encoder jumped {} counts", delta). Records only go to the GUI.
+#define RT_LOG(severity, ...) remote_log().log(mahi::util::severity, __VA_ARGS__)
@@ -0,0 +1,162 @@
+#include "IPendulum.hpp"
+#include "ControlLoop.hpp"  // for SteadyClock, NOT_PLOTTED
+#include "Recording.hpp"    // for RecordingReader
+#include "Csv.hpp"          // for csv_write
+#include <algorithm>        // for std::fill, std::max
+#include <chrono>           // for std::chrono::duration
+#include <cmath>            // for std::fabs, std::sqrt
+#include <cstdio>           // for std::fopen, std::fprintf
+
+//=============================================================================
+// OFFLINE REPLAY
+//=============================================================================
+// Feeds a session recording made with the GUI's Record button through the
+// controller on the calling thread, as fast as it will go. There is no I/O
+// backend, Timer or socket: each recorded sample becomes the tick's inputs,
+// and the command the controller returns is compared to the recorded one.
+
+bool IPendulum::replay(const std::string& path, const RunOptions& options) {
+    if (m_running) {
+        LOG(Warning) << "The pendulum controller is already running!";
+        return false;
+    }
+    RecordingReader reader;
+    if (!reader.open(path)) {
+        LOG(Error) << "Failed to open " << path << " as a recording.";
+        return false;
+    }
+    const RecordingHeader& header = reader.header();
+    if (header.protocol != PROTOCOL_VERSION) {
+        LOG(Error) << path << " holds protocol version " << header.protocol << " frames but this controller reads version " << PROTOCOL_VERSION << ".";
+        return false;
+    }
+    if (header.loop_rate <= 0) {
+        LOG(Error) << path << " has no loop rate.";
+        return false;
+    }
+    // the controller sees the recording's samples, which are only its ticks if nothing was decimated
+    int decimation = std::max(header.decimation, 1);
+    double sample_rate = header.loop_rate / decimation;
+    if (decimation > 1)
+        LOG(Warning) << path << " holds every " << decimation << " tick(s), so the controller is replayed at "
+                     << sample_rate << " Hz instead of the " << header.loop_rate << " Hz it ran at.";
+    std::FILE* file = nullptr;
+    if (!options.replay_out.empty()) {
+        file = std::fopen(options.replay_out.c_str(), "wb");
+        if (!file) {
+            LOG(Error) << "Failed to open " << options.replay_out << ".";
+            return false;
+        }
+    }
+    Mode mode = (Mode)options.mode;
+    LOG(Info) << "Replaying " << path << " through " << (mode == Mode::Encoder ? "control_encoder" : "control_midori") << " ...";
+
+    // CSV columns, gathered a chunk at a time; plot channels are fixed when the first chunk is written
+    enum { ColTime, ColSense, ColMidori, ColEncoder, ColEnable, ColRecorded, ColReplayed, ColDiff, ColCount };
+    std::vector<std::vector<double>> columns(ColCount + m_max_channels);
+    std::vector<const double*> pointers;
+    int csv_channels = -1;
+    bool written = true;
+    // comparison
+    std::int64_t samples = 0, mismatches = 0, gaps = 0;
+    double max_diff = 0, sum_sq = 0;
+    int first_tick = 0, last_tick = 0, first_mismatch = 0, max_tick = 0;
+    Inputs inputs;
+    std::vector<unsigned char> payload;
+    ChunkHeader chunk;
+    m_conditioner.start(sample_rate);
+    m_running = true;
+    auto start = SteadyClock::now();
+    while (!s_stop && reader.next(chunk)) {
+        if (chunk.type != ChunkFrames || !reader.read(chunk, payload)) {
+            reader.skip();
+            continue;
+        }
+        RecordingReader::for_each_frame(payload, [&](const FrameView& frame) {
+            for (int s = 0; s < frame.samples(); ++s) {
+                SampleRef sample = frame.sample(s);
+                int tick = sample.tick();
+                if (samples == 0)
+                    first_tick = tick;
+                else if (tick != last_tick + decimation)
+                    gaps++;
+                last_tick = tick;
+                inputs.sense   = sample.sense();
+                inputs.midori  = sample.midori();
+                inputs.encoder = sample.encoder();
+                m_conditioner.update(inputs);
+                double t = tick / header.loop_rate;
+                double command = mode == Mode::Encoder ? control_encoder(t, inputs.encoder) : control_midori(t, inputs.midori);
+                double diff = command - sample.command();
+                // NaN never compares greater, so test for a match instead
+                if (!(std::fabs(diff) <= options.replay_tolerance)) {
+                    if (mismatches++ == 0)
+                        first_mismatch = tick;
+                }
+                if (!(std::fabs(diff) <= max_diff)) {
+                    max_diff = std::fabs(diff);
+                    max_tick = tick;
+                }
+                sum_sq += diff * diff;
+                samples++;
+                if (file) {
+                    columns[ColTime].push_back(t);
+                    columns[ColSense].push_back(inputs.sense);
+                    columns[ColMidori].push_back(inputs.midori);
+                    columns[ColEncoder].push_back(inputs.encoder);
+                    columns[ColEnable].push_back(sample.enable());
+                    columns[ColRecorded].push_back(sample.command());
+                    columns[ColReplayed].push_back(command);
+                    columns[ColDiff].push_back(diff);
+                    for (int i = 0; i < (csv_channels < 0 ? m_max_channels : csv_channels); ++i)
+                        columns[ColCount + i].push_back(m_values[i]);
+                }
+                std::fill(m_values.get(), m_values.get() + m_max_channels, NOT_PLOTTED);
+            }
+        });
+        if (file && !columns[ColTime].empty()) {
+            if (csv_channels < 0) {
+                csv_channels = m_channels.load(std::memory_order_relaxed);
+                std::fprintf(file, "Time [s],Sense [V],Midori [V],Encoder [counts],Enable,Recorded Command [V],Replayed Command [V],Difference [V],");
+                for (int id = 0; id < csv_channels; ++id)
+                    std::fprintf(file, "%s,", m_labels[id].c_str());
+                std::fprintf(file, "\n");
+                pointers.resize(ColCount + csv_channels);
+            }
+            for (std::size_t c = 0; c < pointers.size(); ++c)
+                pointers[c] = columns[c].data();
+            written &= csv_write(file, pointers, columns[ColTime].size());
+            for (auto& column : columns)
+                column.clear();
+        }
+    }
+    double elapsed = std::chrono::duration<double>(SteadyClock::now() - start).count();
+    m_running = false;
+
+    if (file) {
+        written &= std::fclose(file) == 0;
+        if (!written)
+            LOG(Error) << "Failed to write " << options.replay_out << ". Is the disk full?";
+        else if (m_channels.load(std::memory_order_relaxed) > std::max(csv_channels, 0))
+            LOG(Warning) << "Plot channels first used after the recording's first chunk aren't in " << options.replay_out << ".";
+    }
+    if (s_stop)
+        LOG(Warning) << "Replay stopped early.";
+    if (samples == 0) {
+        LOG(Error) << path << " has no samples.";
+        return false;
+    }
+    double duration = (last_tick - first_tick + decimation) / header.loop_rate;
+    LOG(Info) << "Replayed " << samples << " samples (" << duration << " s) in " << elapsed << " s, "
+              << (elapsed > 0 ? duration / elapsed : 0) << "x real time.";
+    if (gaps)
+        LOG(Warning) << "The recording skips ticks " << gaps << " time(s) (lost samples), so a controller with state may differ after them.";
+    LOG(Info) << "Command difference: max " << max_diff << " V at tick " << max_tick << ", RMS " << std::sqrt(sum_sq / samples) << " V.";
+    if (mismatches) {
+        LOG(Error) << mismatches << " of " << samples << " commands differ by more than " << options.replay_tolerance
+                   << " V, first at tick " << first_mismatch << ".";
+        return false;
+    }
+    LOG(Info) << "Every command matches within " << options.replay_tolerance << " V.";
+    return written;
+}
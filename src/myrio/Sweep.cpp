@@ -0,0 +1,234 @@
+#include "IPendulum.hpp"
+#include "ControlLoop.hpp"       // for SteadyClock
+#include "WorkStealingPool.hpp"  // for WorkStealingPool
+#include <algorithm>             // for std::sort, std::max
+#include <chrono>                // for std::chrono::duration
+#include <cmath>                 // for std::fabs, std::sqrt, std::isnan
+#include <cstdio>                // for std::printf, std::fprintf
+#include <cstdlib>               // for std::strtod, std::strtol
+#include <limits>                // for std::numeric_limits
+#ifdef PENDULUM_SIM
+#include "SimHardware.hpp"       // for SimHardware
+#endif
+
+//=============================================================================
+// PARAMETER SWEEP
+//=============================================================================
+// Tunes gains against the simulated plant instead of the rig. Every point of
+// the grid of gains runs in its own pendulum and SimHardware, so nothing is
+// shared between runs and they can all run at once. Each run starts from
+// --sweep-angle with the amplifier enabled and lasts --sweep-time, and its
+// response is summarized from the plant's angle, taking the mean over the
+// last tenth of the run as where it settled.
+
+#ifdef PENDULUM_SIM
+
+/// One swept gain and the values it takes.
+struct SweepAxis {
+    std::string         name;   ///< the name the gain was registered with
+    std::vector<double> values; ///< the values swept
+};
+
+/// Closed-loop response of one run.
+struct SweepMetrics {
+    double settling   = 0; ///< when the angle last left its settling band [s], or NaN if it never settled
+    double overshoot  = 0; ///< how far the angle went past where it settled [% of the step]
+    double rms        = 0; ///< RMS amplifier command [V]
+    double saturation = 0; ///< time spent at the amplifier's current limit [s]
+    double final      = 0; ///< where the angle settled [rad]
+};
+
+/// One run of a sweep.
+struct SweepRun {
+    std::vector<double> gains;   ///< the value of each SweepAxis
+    SweepMetrics        metrics; ///< its response
+    bool                ok = false; ///< did it run to the end?
+};
+
+/// Parses "name=from:to:count" or "name=v1,v2,...". Returns false if it is malformed.
+static bool parse_axis(const std::string& spec, SweepAxis& axis) {
+    std::size_t eq = spec.find('=');
+    if (eq == 0 || eq == std::string::npos || eq + 1 == spec.size())
+        return false;
+    axis.name = spec.substr(0, eq);
+    axis.values.clear();
+    const char* p = spec.c_str() + eq + 1;
+    char* end;
+    if (spec.find(':', eq) != std::string::npos) {
+        double from = std::strtod(p, &end);
+        if (*end != ':')
+            return false;
+        double to = std::strtod(end + 1, &end);
+        if (*end != ':')
+            return false;
+        long count = std::strtol(end + 1, &end, 10);
+        if (*end || count < 1)
+            return false;
+        for (long i = 0; i < count; ++i)
+            axis.values.push_back(count == 1 ? from : from + (to - from) * i / (count - 1));
+        return true;
+    }
+    for (;;) {
+        axis.values.push_back(std::strtod(p, &end));
+        if (end == p)
+            return false;
+        if (!*end)
+            return true;
+        if (*end != ',')
+            return false;
+        p = end + 1;
+    }
+}
+
+/// Summarizes a response from its angle every tick.
+static SweepMetrics response(const std::vector<double>& angle, double dt, double band) {
+    SweepMetrics m;
+    std::size_t n = angle.size();
+    std::size_t tail = n - std::max<std::size_t>(n / 10, 1);
+    for (std::size_t i = tail; i < n; ++i)
+        m.final += angle[i];
+    m.final /= (double)(n - tail);
+    double step = m.final - angle[0];
+    // the band is a share of the step, but never finer than the encoder can see
+    band = std::max(band, 0.02 * std::fabs(step));
+    std::size_t last = 0;
+    double past = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (std::fabs(angle[i] - m.final) > band)
+            last = i + 1;
+        past = std::max(past, step >= 0 ? angle[i] - m.final : m.final - angle[i]);
+    }
+    // still leaving the band in the last tenth means it never settled
+    m.settling  = last > tail ? std::numeric_limits<double>::quiet_NaN() : last * dt;
+    m.overshoot = std::fabs(step) > band ? 100 * past / std::fabs(step) : 0;
+    return m;
+}
+
+bool sweep(Frequency loop_rate, const RunOptions& options, const std::function<IPendulum*()>& make) {
+    std::vector<SweepAxis> axes(options.sweep.size());
+    int runs = 1;
+    for (std::size_t a = 0; a < axes.size(); ++a) {
+        if (!parse_axis(options.sweep[a], axes[a])) {
+            LOG(Error) << "Expected --sweep name=from:to:count or name=v1,v2,... but got \"" << options.sweep[a] << "\".";
+            return false;
+        }
+        runs *= (int)axes[a].values.size();
+    }
+    // check the names once here rather than in every run
+    {
+        std::unique_ptr<IPendulum> probe(make());
+        for (auto& axis : axes) {
+            if (!probe->set_gain(axis.name, axis.values[0])) {
+                LOG(Error) << "There is no gain named " << axis.name << ". Register it in your constructor with gain(\"" << axis.name << "\", member).";
+                return false;
+            }
+        }
+    }
+    int ticks = std::max((int)std::lround(options.sweep_time * loop_rate.as_hertz()), 1);
+    double dt = 1 / loop_rate.as_hertz();
+    Mode mode = (Mode)options.mode;
+    PlantParams plant;
+    plant.angle = options.sweep_angle;
+    WorkStealingPool pool(options.sweep_threads);
+    LOG(Info) << "Sweeping " << runs << " run(s) of " << options.sweep_time << " s through " << (mode == Mode::Encoder ? "control_encoder" : "control_midori")
+              << " on " << pool.threads() << " thread(s) ...";
+
+    std::vector<SweepRun> results(runs);
+    auto start = SteadyClock::now();
+    pool.run(runs, [&](int r, int worker) {
+        SweepRun& run = results[r];
+        // the last axis varies fastest
+        std::unique_ptr<IPendulum> pendulum(make());
+        run.gains.resize(axes.size());
+        for (int a = (int)axes.size() - 1, i = r; a >= 0; --a) {
+            run.gains[a] = axes[a].values[i % axes[a].values.size()];
+            i /= (int)axes[a].values.size();
+            pendulum->set_gain(axes[a].name, run.gains[a]);
+        }
+        SimHardware hw(plant);
+        std::vector<double> angle;
+        angle.reserve(ticks);
+        double sum_sq = 0;
+        int saturated = 0;
+        run.ok = pendulum->simulate(loop_rate, ticks, mode, hw, [&](const State& state) {
+            angle.push_back(hw.plant().angle());
+            sum_sq += state.command * state.command;
+            if (std::fabs(plant.amp_gain * state.command) >= plant.amp_limit)
+                saturated++;
+        });
+        if (!run.ok)
+            return;
+        run.metrics = response(angle, dt, 2 * PI / plant.cpr);
+        run.metrics.rms        = std::sqrt(sum_sq / ticks);
+        run.metrics.saturation = saturated * dt;
+    });
+    double elapsed = std::chrono::duration<double>(SteadyClock::now() - start).count();
+    int failed = 0;
+    for (auto& run : results)
+        failed += !run.ok;
+    LOG(Info) << "Simulated " << runs * options.sweep_time << " s in " << elapsed << " s, "
+              << (elapsed > 0 ? runs * options.sweep_time / elapsed : 0) << "x real time.";
+    if (failed)
+        LOG(Warning) << failed << " run(s) were stopped or failed to open the simulator.";
+
+    if (!options.sweep_out.empty()) {
+        std::FILE* file = std::fopen(options.sweep_out.c_str(), "wb");
+        if (!file) {
+            LOG(Error) << "Failed to open " << options.sweep_out << ".";
+            return false;
+        }
+        for (auto& axis : axes)
+            std::fprintf(file, "%s,", axis.name.c_str());
+        std::fprintf(file, "Settling [s],Overshoot [%%],RMS Command [V],Saturation [s],Final Angle [rad]\n");
+        for (auto& run : results) {
+            if (!run.ok)
+                continue;
+            for (double g : run.gains)
+                std::fprintf(file, "%.17g,", g);
+            std::fprintf(file, "%.17g,%.17g,%.17g,%.17g,%.17g\n", run.metrics.settling, run.metrics.overshoot,
+                         run.metrics.rms, run.metrics.saturation, run.metrics.final);
+        }
+        if (std::fclose(file) != 0) {
+            LOG(Error) << "Failed to write " << options.sweep_out << ". Is the disk full?";
+            return false;
+        }
+    }
+
+    // fastest settling first, then least overshoot; runs that never settled go last
+    std::vector<const SweepRun*> ranked;
+    for (auto& run : results) {
+        if (run.ok)
+            ranked.push_back(&run);
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const SweepRun* a, const SweepRun* b) {
+        bool a_settled = !std::isnan(a->metrics.settling), b_settled = !std::isnan(b->metrics.settling);
+        if (a_settled != b_settled)
+            return a_settled;
+        if (a_settled && a->metrics.settling != b->metrics.settling)
+            return a->metrics.settling < b->metrics.settling;
+        return a->metrics.overshoot < b->metrics.overshoot;
+    });
+    std::printf("\n");
+    for (auto& axis : axes)
+        std::printf("%12s ", axis.name.c_str());
+    std::printf("%12s %12s %12s %12s %12s\n", "Settling [s]", "Overshoot %", "RMS Cmd [V]", "Saturated [s]", "Final [rad]");
+    for (auto* run : ranked) {
+        for (double g : run->gains)
+            std::printf("%12.4g ", g);
+        if (std::isnan(run->metrics.settling))
+            std::printf("%12s ", "-");
+        else
+            std::printf("%12.3f ", run->metrics.settling);
+        std::printf("%12.1f %12.3f %12.3f %12.4f\n", run->metrics.overshoot, run->metrics.rms, run->metrics.saturation, run->metrics.final);
+    }
+    return failed == 0;
+}
+
+#else
+
+bool sweep(Frequency loop_rate, const RunOptions& options, const std::function<IPendulum*()>& make) {
+    LOG(Error) << "Sweeps run against the simulated plant, so run them with pendulum-sim.";
+    return false;
+}
+
+#endif
@@ -1,5 +1,5 @@
-#include "IPendulum.hpp" // for IPendulum 
-#include "Iir.h"         // for filters
+#include "PendulumRunner.hpp" // for PendulumRunner
+#include "Iir.h"               // for filters
 
 //=============================================================================
 // PENDULUM
@@ -7,14 +7,15 @@
 
 using namespace mahi::util;
 
-/// Your pendulum implementation inherits from IPendulum.
-class MyPendulum : public IPendulum {
+/// Your pendulum implementation inherits from PendulumRunner (or IPendulum).
+class MyPendulum : public PendulumRunner<MyPendulum> {
 public:
     /// Constructor. Called when we make our MyPendulum instance in main().
-    MyPendulum(double sample_freq_): sample_freq(sample_freq_) {      
+    MyPendulum(double sample_freq_): sample_freq(sample_freq_), my_filter(2, hertz(10), hertz(sample_freq_)) {      
         
         ///// IF YOU NEED TO DO ANY SETUP FOR VARIABLES, THAT GOES HERE /////
-        // my_filter.setup(sample_freq, 10.0);
+        // gains registered here can be tuned in the simulator with --sweep (see README)
+        gain("Kp", kp);
         // ... any other setup you want to do 
         
         ///// END SETUP /////
@@ -25,14 +26,11 @@ public:
         // This function should compute an amplifier command voltage given the
         // current controller time in seconds and Midori position in volts. 
 
-        // See tips in the wiki for static variables
-        static double volts_last = 0.0;
-
         // See tips in the wiki for plotting variables
         double my_var = sin(2*PI*1.0*t);
-        plot("My Variable 2", my_var); 
+        my_var_2.set(my_var); 
 
-        // See tips in the wiki for static variables
+        // keep values between samples in member variables (see below)
         volts_last = midori_volts;
 
         double command_voltage = 0;
@@ -45,18 +43,14 @@ public:
         // This function should compute an amplifier command voltage given the
         // current controller time in seconds and encoder position in counts. 
 
-        // See tips in the wiki for static variables
-        static int counts_last = 0.0;
-
-        // See tips in the wiki for filtering 
-        static Butterworth my_filter(2, hertz(10), hertz(sample_freq));
+        // See tips in the wiki for filtering (my_filter is set up in the constructor)
         double counts_filtered = my_filter.update(counts);
 
         // See tips in the wiki for plotting
         double my_var = sin(2*PI*0.5*t);
-        plot("My Variable 1", my_var); 
+        my_var_1.set(my_var); 
 
-        // See tips in the wiki for static variables
+        // keep values between samples in member variables (see below)
         counts_last = counts;
 
         double command_voltage = 0;
@@ -65,9 +59,17 @@ public:
 
 public:
     double sample_freq;       // our samplerate in Hz
+
+    // plot channels shown in the GUI (plot("label", value) also works, but is slower in a control loop)
+    PlotChannel my_var_1 = channel("My Variable 1");
+    PlotChannel my_var_2 = channel("My Variable 2");
     
-    ///// YOU CAN PUT VARIABLES HERE TO KEEP BETWEEN SAMPLES /////
-    /////   BUT STATIC VARIABLES WILL PROBABLY WORK INSTEAD  /////
+    ///// PUT VARIABLES HERE TO KEEP BETWEEN SAMPLES /////
+    // (static variables would be shared by every MyPendulum, e.g. in a --sweep)
+    double      kp          = 0.0; // proportional gain (registered in the constructor)
+    double      volts_last  = 0.0; // the last Midori voltage
+    int         counts_last = 0;   // the last encoder counts
+    Butterworth my_filter;         // encoder filter
 
     ///// END VARIABLES ///// 
 };
@@ -80,14 +82,18 @@ public:
 int main(int argc, char const *argv[]) {    
 
     ////// ADJUST YOUR SAMPLE RATE HERE //////
-    // Don't increase past 2 kHz here
+    // Control runs at up to 10 kHz; the GUI is streamed at 1 kHz regardless (see --telemetry-rate)
     Frequency sample_rate = hertz(1000);
     //////  DON'T TOUCH ANYTHING ELSE  ///////
 
+    RunOptions options = parse_run_options(argc, argv);
+    // with --sweep, tune gains in many simulated pendulums at once instead
+    if (!options.sweep.empty())
+        return sweep(sample_rate, options, [=]() { return new MyPendulum(sample_rate.as_hertz()); }) ? 0 : 1;
     // create an instance of your pendulum
     MyPendulum pend(sample_rate.as_hertz());
-    // run the pendulum at 1 kHz (don't increase past 2 kHz)
-    pend.run(sample_rate);
+    // run the pendulum at the sample rate, on the ports given with --port (or replay a recording with --replay)
+    bool ok = pend.run(sample_rate, options);
     // return 0 for success
-    return 0;
+    return ok ? 0 : 1;
 }
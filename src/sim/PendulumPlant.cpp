@@ -0,0 +1,34 @@
+#include "PendulumPlant.hpp"
+#include <algorithm>  // for std::min, std::max
+#include <cmath>      // for std::sin, std::tanh
+
+static constexpr double GRAVITY = 9.81; // [m/s^2]
+
+PendulumPlant::PendulumPlant(const PlantParams& params) :
+    m_params(params)
+{
+    reset();
+}
+
+void PendulumPlant::reset() {
+    m_angle    = m_params.angle;
+    m_velocity = 0;
+    m_current  = 0;
+}
+
+void PendulumPlant::step(double command_volts, bool enabled, double dt) {
+    // the amplifier runs in current mode, so current follows the command up to its limit
+    double current = enabled ? m_params.amp_gain * command_volts : 0;
+    m_current = std::max(-m_params.amp_limit, std::min(m_params.amp_limit, current));
+    int    n = std::max(m_params.substeps, 1);
+    double h = dt / n;
+    for (int i = 0; i < n; ++i) {
+        double torque = m_params.kt * m_current
+                      - m_params.mass * GRAVITY * m_params.length * std::sin(m_angle)
+                      - m_params.damping * m_velocity
+                      - m_params.friction * std::tanh(m_velocity / 0.01);
+        // semi-implicit Euler keeps the undamped pendulum's energy bounded
+        m_velocity += h * torque / m_params.inertia;
+        m_angle    += h * m_velocity;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/// Physical parameters of the simulated pendulum, motor and amplifier.
+struct PlantParams {
+    double amp_gain      = 1.0;    ///< amplifier transconductance                   [A/V]
+    double amp_limit     = 6.0;    ///< amplifier continuous current limit           [A]
+    double sense_gain    = 0.5;    ///< amplifier current monitor gain               [V/A]
+    double kt            = 0.0385; ///< motor torque constant                        [Nm/A]
+    double mass          = 0.2;    ///< pendulum mass                                [kg]
+    double length        = 0.15;   ///< distance from pivot to center of mass        [m]
+    double inertia       = 0.005;  ///< pendulum and rotor inertia about the pivot   [kg*m^2]
+    double damping       = 1e-4;   ///< viscous friction                             [Nm*s/rad]
+    double friction      = 1e-3;   ///< Coulomb friction                             [Nm]
+    double midori_gain   = 0.84;   ///< Midori pot sensitivity                       [V/rad]
+    double midori_offset = 2.5;    ///< Midori pot voltage at zero angle             [V]
+    int    cpr           = 500;    ///< encoder counts per revolution                [counts]
+    double angle         = 0;      ///< initial angle, measured from hanging down    [rad]
+    double noise         = 0;      ///< standard deviation of analog input noise     [V]
+    int    substeps      = 10;     ///< integration substeps per controller tick
+};
+
+/// Rigid pendulum driven by a current controlled DC motor.
+class PendulumPlant {
+public:
+    /// Constructor.
+    PendulumPlant(const PlantParams& params = PlantParams());
+    /// Resets the pendulum to its initial angle at rest.
+    void reset();
+    /// Advances the plant by dt seconds with a constant amplifier command.
+    void step(double command_volts, bool enabled, double dt);
+    /// The pendulum angle from hanging down [rad].
+    double angle() const { return m_angle; }
+    /// The pendulum angular velocity [rad/s].
+    double velocity() const { return m_velocity; }
+    /// The motor current after amplifier saturation [A].
+    double current() const { return m_current; }
+    /// The plant parameters.
+    const PlantParams& params() const { return m_params; }
+private:
+    PlantParams m_params;   // physical parameters
+    double      m_angle;    // pendulum angle [rad]
+    double      m_velocity; // pendulum angular velocity [rad/s]
+    double      m_current;  // motor current [A]
+};
@@ -0,0 +1,47 @@
+#include "SimHardware.hpp"
+#include <cmath>  // for std::floor
+
+using namespace mahi::util;
+
+SimHardware::SimHardware(const PlantParams& params) :
+    m_plant(params),
+    m_dt(0.001),
+    m_zero(0),
+    m_first(true),
+    m_rng(488),
+    m_noise(0.0, params.noise > 0 ? params.noise : 1.0)
+{ }
+
+bool SimHardware::open(Frequency loop_rate) {
+    m_dt      = 1.0 / loop_rate.as_hertz();
+    m_outputs = Outputs();
+    m_first   = true;
+    m_plant.reset();
+    m_zero = m_plant.angle();
+    return true;
+}
+
+void SimHardware::close() {
+    m_outputs = Outputs();
+}
+
+void SimHardware::read(Inputs& inputs) {
+    // advance the plant over the period since the last write
+    if (!m_first)
+        m_plant.step(m_outputs.command, m_outputs.enable, m_dt);
+    m_first = false;
+    auto& p = m_plant.params();
+    double noise_sense  = p.noise > 0 ? m_noise(m_rng) : 0;
+    double noise_midori = p.noise > 0 ? m_noise(m_rng) : 0;
+    inputs.sense   = p.sense_gain * m_plant.current() + noise_sense;
+    inputs.midori  = p.midori_offset + p.midori_gain * m_plant.angle() + noise_midori;
+    inputs.encoder = (int)std::floor((m_plant.angle() - m_zero) / (2 * PI / p.cpr));
+}
+
+void SimHardware::write(const Outputs& outputs) {
+    m_outputs = outputs;
+}
+
+void SimHardware::zero_encoder() {
+    m_zero = m_plant.angle();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "IHardware.hpp"      // for IHardware
+#include "PendulumPlant.hpp"  // for PendulumPlant
+#include <random>             // for std::mt19937
+
+/// Pendulum I/O backed by a simulated pendulum, motor and amplifier. The 
+/// plant advances one ideal controller period per read(), so a simulation 
+/// is deterministic no matter how fast the loop actually runs.
+class SimHardware final : public IHardware {
+public:
+    /// Constructor.
+    SimHardware(const PlantParams& params = PlantParams());
+    bool open(mahi::util::Frequency loop_rate) override;
+    void close() override;
+    void read(Inputs& inputs) override;
+    void write(const Outputs& outputs) override;
+    void zero_encoder() override;
+    const char* name() const override { return "simulator"; }
+    /// The simulated plant.
+    const PendulumPlant& plant() const { return m_plant; }
+private:
+    PendulumPlant m_plant;          // the simulated pendulum
+    Outputs       m_outputs;        // the most recently written outputs
+    double        m_dt;             // the controller period [s]
+    double        m_zero;           // the angle at which the encoder was zeroed [rad]
+    bool          m_first;          // has the plant not been stepped yet?
+    std::mt19937  m_rng;            // analog noise generator
+    std::normal_distribution<double> m_noise; // analog noise distribution
+};
@@ -0,0 +1,285 @@
+// Unit tests of the telemetry path shared by the controller and the GUI: frame
+// validation, putting samples back in order, and the shared memory ring.
+// Run by CTest; exits with the number of failed checks.
+
+#include "Frame.hpp"          // for FrameWriter, FrameView
+#include "ReorderBuffer.hpp"  // for ReorderBuffer
+#include "ShmRing.hpp"        // for ShmRing
+#include <cstdio>             // for std::printf
+#include <cstring>            // for std::memcpy
+#include <limits>             // for std::numeric_limits
+#include <string>             // for std::string, std::to_string
+#include <vector>             // for std::vector
+#ifdef __linux__
+#include <unistd.h>           // for getpid
+#endif
+
+static int g_failures = 0;
+
+/// Records a failed check with where it failed, and carries on.
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+//=============================================================================
+// REORDER BUFFER
+//=============================================================================
+
+/// Records the ticks a ReorderBuffer releases, and checks their values came along.
+struct Collect {
+    void operator()(const State& state, const double* values, int count) const {
+        CHECK(count == 2 && values[0] == state.tick && values[1] == -state.tick);
+        released->push_back(state.tick);
+    }
+    std::vector<int>* released;
+};
+
+/// A ReorderBuffer and the ticks it has released.
+struct Reorder {
+    Reorder(int window = 8, double hold = 0.05) : buffer(window, 2, hold) { }
+
+    void push(int tick, double now = 0, int decimation = 1) {
+        State state = {};
+        state.tick = tick;
+        double values[2] = {(double)tick, -(double)tick};
+        buffer.push(state, values, 2, decimation, now, Collect{&released});
+    }
+
+    void release(double now) { buffer.release(now, Collect{&released}); }
+
+    void flush() { release(std::numeric_limits<double>::infinity()); }
+
+    ReorderBuffer    buffer;
+    std::vector<int> released;
+};
+
+static void test_reorder_in_order() {
+    Reorder r;
+    for (int tick = 0; tick < 20; ++tick)
+        r.push(tick);
+    CHECK(r.released.size() == 20);
+    CHECK(r.released.front() == 0 && r.released.back() == 19);
+    CHECK(r.buffer.buffered() == 0);
+    const ReorderStats& s = r.buffer.stats();
+    CHECK(s.received == 20 && s.lost == 0 && s.late == 0 && s.duplicates == 0 && s.reordered == 0);
+}
+
+static void test_reorder_decimated() {
+    // samples are keyed on tick / decimation, so every 10th tick is consecutive
+    Reorder r;
+    r.push(0, 0, 10);
+    r.push(20, 0, 10);
+    r.push(10, 0, 10);
+    CHECK((r.released == std::vector<int>{0, 10, 20}));
+    CHECK(r.buffer.stats().lost == 0 && r.buffer.stats().reordered == 1);
+}
+
+static void test_reorder_reordered() {
+    Reorder r;
+    r.push(0);
+    r.push(2);
+    r.push(3);
+    CHECK(r.released.size() == 1);
+    CHECK(r.buffer.buffered() == 2);
+    r.push(1);
+    CHECK((r.released == std::vector<int>{0, 1, 2, 3}));
+    const ReorderStats& s = r.buffer.stats();
+    CHECK(s.received == 4 && s.reordered == 1 && s.lost == 0 && s.duplicates == 0);
+}
+
+static void test_reorder_duplicates() {
+    Reorder r;
+    r.push(0);
+    r.push(0); // already released
+    r.push(2);
+    r.push(2); // still held
+    r.push(1);
+    CHECK((r.released == std::vector<int>{0, 1, 2}));
+    const ReorderStats& s = r.buffer.stats();
+    CHECK(s.received == 3 && s.duplicates == 2 && s.late == 0 && s.lost == 0);
+}
+
+static void test_reorder_gap() {
+    Reorder r(8, 0.05);
+    r.push(0, 0.0);
+    r.push(2, 0.0);
+    // the gap at 1 is waited on until 2 has been held for the hold time
+    r.release(0.04);
+    CHECK((r.released == std::vector<int>{0}));
+    r.release(0.06);
+    CHECK((r.released == std::vector<int>{0, 2}));
+    CHECK(r.buffer.stats().lost == 1);
+    // the missing sample turns up after it was skipped: late, and no longer lost
+    r.push(1, 0.07);
+    CHECK(r.released.size() == 2);
+    CHECK(r.buffer.stats().late == 1 && r.buffer.stats().lost == 0);
+    // a second copy of it is a duplicate, not another late sample
+    r.push(2, 0.08);
+    CHECK(r.buffer.stats().late == 1 && r.buffer.stats().duplicates == 1);
+}
+
+static void test_reorder_window_overflow() {
+    // a sample a whole window ahead skips the gap without waiting
+    Reorder r(8, 1e9);
+    r.push(0);
+    r.push(20);
+    CHECK((r.released == std::vector<int>{0}));
+    CHECK(r.buffer.stats().lost == 12); // 1...12 make room for 20 in the window 13...20
+    r.flush();
+    CHECK((r.released == std::vector<int>{0, 20}));
+    CHECK(r.buffer.stats().lost == 19);
+    // older than the history: late, without touching the lost count
+    r.push(5);
+    CHECK(r.buffer.stats().late == 1 && r.buffer.stats().lost == 19);
+    CHECK(r.buffer.stats().received == 2);
+}
+
+//=============================================================================
+// FRAMES
+//=============================================================================
+
+/// Builds a finished frame of samples with 3 channels.
+static std::vector<unsigned char> make_frame(int samples) {
+    FrameWriter writer(MAX_FRAME_BYTES, 3);
+    writer.begin(3, 2);
+    for (int i = 0; i < samples; ++i) {
+        State state = {};
+        state.tick    = 2 * i;
+        state.encoder = -i;
+        state.sense   = 0.5 * i;
+        state.enable  = 1;
+        double values[3] = {1.5, -2.0, (double)i};
+        writer.append(state, values);
+    }
+    writer.finish();
+    return std::vector<unsigned char>(writer.data(), writer.data() + writer.size());
+}
+
+static void test_frame_valid() {
+    std::vector<unsigned char> bytes = make_frame(4);
+    FrameView view;
+    CHECK(view.parse(bytes.data(), bytes.size()) == FrameView::Ok);
+    CHECK(view.size() == bytes.size());
+    CHECK(view.samples() == 4 && view.channels() == 3 && view.decimation() == 2);
+    CHECK(view.sample(3).tick() == 6 && view.sample(3).encoder() == -3);
+    CHECK(view.sample(3).sense() == 1.5 && view.sample(3).enable() == 1);
+    CHECK(view.sample(3).value(0) == 1.5 && view.sample(3).value(2) == 3.0);
+    // trailing bytes past the frame are ignored
+    bytes.push_back(0);
+    CHECK(view.parse(bytes.data(), bytes.size()) == FrameView::Ok);
+    CHECK(view.size() == bytes.size() - 1);
+}
+
+static void test_frame_crc() {
+    // CRC-32 check value of the IEEE 802.3 polynomial
+    CHECK(frame_crc32((const unsigned char*)"123456789", 9) == 0xCBF43926u);
+    std::vector<unsigned char> bytes = make_frame(4);
+    FrameView view;
+    // a flipped bit anywhere, header or samples, is caught
+    for (std::size_t i : {std::size_t(9), std::size_t(FRAME_HEADER_BYTES + 3), bytes.size() - 1}) {
+        std::vector<unsigned char> corrupt = bytes;
+        corrupt[i] ^= 0x10;
+        CHECK(view.parse(corrupt.data(), corrupt.size()) == FrameView::BadChecksum);
+    }
+}
+
+static void test_frame_truncated() {
+    std::vector<unsigned char> bytes = make_frame(4);
+    FrameView view;
+    CHECK(view.parse(bytes.data(), bytes.size() - 1) == FrameView::Truncated);
+    CHECK(view.parse(bytes.data(), FRAME_HEADER_BYTES) == FrameView::Truncated);
+    CHECK(view.parse(bytes.data(), FRAME_HEADER_BYTES - 1) == FrameView::Truncated);
+    CHECK(view.parse(bytes.data(), 0) == FrameView::Truncated);
+    CHECK(view.size() == 0);
+}
+
+static void test_frame_rejected() {
+    std::vector<unsigned char> bytes = make_frame(1);
+    FrameView view;
+    std::vector<unsigned char> version = bytes;
+    wire_put<std::uint16_t>(version.data() + 4, PROTOCOL_VERSION + 1);
+    CHECK(view.parse(version.data(), version.size()) == FrameView::BadVersion);
+    std::vector<unsigned char> magic = bytes;
+    magic[0] ^= 0xFF;
+    CHECK(view.parse(magic.data(), magic.size()) == FrameView::BadMagic);
+}
+
+//=============================================================================
+// SHARED MEMORY RING
+//=============================================================================
+
+static void test_shm_ring_lapped() {
+#ifdef __linux__
+    std::string name = "/pendulum-test-" + std::to_string(getpid());
+    ShmRing producer, reader;
+    CHECK(producer.create(name, 8, 64));
+    CHECK(reader.open(name));
+    if (!producer.is_open() || !reader.is_open())
+        return;
+    unsigned char frame[128] = {};
+    unsigned char buffer[64];
+    std::size_t size = 0;
+    std::int64_t skipped = 0;
+    auto publish = [&](std::uint32_t n) {
+        std::memcpy(frame, &n, sizeof(n));
+        CHECK(producer.publish(frame, 4 + n % 8));
+    };
+    auto next = [&]() -> std::uint32_t {
+        std::uint32_t n = 0;
+        if (reader.read(buffer, size, skipped))
+            std::memcpy(&n, buffer, sizeof(n));
+        return n;
+    };
+    // frames too big for a slot are refused
+    CHECK(!producer.publish(frame, 65));
+    // within a lap, every frame arrives in order and whole
+    for (std::uint32_t n = 1; n <= 5; ++n)
+        publish(n);
+    for (std::uint32_t n = 1; n <= 5; ++n) {
+        CHECK(next() == n);
+        CHECK(size == 4 + n % 8);
+    }
+    CHECK(!reader.read(buffer, size, skipped));
+    CHECK(skipped == 0);
+    // 20 frames behind on a ring of 8: the 12 overwritten are skipped, the last 8 read
+    for (std::uint32_t n = 6; n <= 25; ++n)
+        publish(n);
+    CHECK(next() == 18);
+    CHECK(skipped == 12);
+    for (std::uint32_t n = 19; n <= 25; ++n)
+        CHECK(next() == n);
+    CHECK(!reader.read(buffer, size, skipped));
+    CHECK(skipped == 12);
+    // exactly one lap behind loses nothing
+    for (std::uint32_t n = 26; n <= 33; ++n)
+        publish(n);
+    for (std::uint32_t n = 26; n <= 33; ++n)
+        CHECK(next() == n);
+    CHECK(skipped == 12);
+#else
+    std::printf("ShmRing is only implemented on Linux; skipped.\n");
+#endif
+}
+
+int main() {
+    test_reorder_in_order();
+    test_reorder_decimated();
+    test_reorder_reordered();
+    test_reorder_duplicates();
+    test_reorder_gap();
+    test_reorder_window_overflow();
+    test_frame_valid();
+    test_frame_crc();
+    test_frame_truncated();
+    test_frame_rejected();
+    test_shm_ring_lapped();
+    if (g_failures == 0)
+        std::printf("All telemetry tests passed.\n");
+    else
+        std::printf("%d telemetry check(s) failed.\n", g_failures);
+    return g_failures;
+}
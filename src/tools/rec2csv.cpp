@@ -0,0 +1,163 @@
+#include "Recording.hpp"  // for RecordingReader
+#include "Csv.hpp"        // for csv_write
+#include <cstdio>         // for std::fprintf
+#include <cstdlib>        // for std::atoi
+#include <cstring>        // for std::strcmp
+#include <limits>         // for std::numeric_limits
+
+//=============================================================================
+// PENDULUM-REC2CSV
+//=============================================================================
+// Converts a session recording made with the GUI's Record button to CSV with
+// the same columns as the GUI's Export. Finished recordings are read through
+// their index, so a tick range only reads the chunks it needs; unfinished
+// recordings (e.g. the GUI crashed) are scanned chunk by chunk.
+
+/// Prints the command line usage.
+static void usage() {
+    std::printf("usage: pendulum-rec2csv <recording.rec> [output.csv] [--from tick] [--to tick]\n");
+}
+
+int main(int argc, char const *argv[]) {
+    std::string input, output;
+    int from = 0;
+    int to   = std::numeric_limits<int>::max();
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--from") && i + 1 < argc)
+            from = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--to") && i + 1 < argc)
+            to = std::atoi(argv[++i]);
+        else if (argv[i][0] == '-') {
+            usage();
+            return 1;
+        }
+        else if (input.empty())
+            input = argv[i];
+        else
+            output = argv[i];
+    }
+    if (input.empty()) {
+        usage();
+        return 1;
+    }
+    if (output.empty())
+        output = input.substr(0, input.find_last_of('.')) + ".csv";
+
+    RecordingReader reader;
+    if (!reader.open(input)) {
+        std::printf("Failed to open %s as a recording.\n", input.c_str());
+        return 1;
+    }
+    const RecordingHeader& header = reader.header();
+    if (header.protocol != PROTOCOL_VERSION) {
+        std::printf("%s holds protocol version %d frames but this tool reads version %d.\n", input.c_str(), header.protocol, PROTOCOL_VERSION);
+        return 1;
+    }
+    if (header.loop_rate <= 0) {
+        std::printf("%s has no loop rate.\n", input.c_str());
+        return 1;
+    }
+
+    // first pass: labels and the widest frame, reading only chunk headers and labels
+    std::vector<std::string> labels;
+    std::vector<unsigned char> payload;
+    ChunkHeader chunk;
+    int channels = 0;
+    while (reader.next(chunk)) {
+        if (chunk.type == ChunkLabels && reader.read(chunk, payload)) {
+            std::size_t pos = 0;
+            for (int i = 0; i < chunk.count && pos + 6 <= payload.size(); ++i) {
+                int id = (int)wire_get<std::uint32_t>(&payload[pos]);
+                std::size_t length = wire_get<std::uint16_t>(&payload[pos + 4]);
+                if (pos + 6 + length > payload.size())
+                    break;
+                if (id >= (int)labels.size())
+                    labels.resize(id + 1);
+                labels[id].assign((const char*)&payload[pos + 6], length);
+                pos += 6 + length;
+            }
+        }
+        else {
+            if (chunk.type == ChunkFrames)
+                channels = std::max(channels, chunk.channels);
+            reader.skip();
+        }
+    }
+    channels = std::max(channels, (int)labels.size());
+
+    std::FILE* file = std::fopen(output.c_str(), "wb");
+    if (!file) {
+        std::printf("Failed to open %s. Is it open in another application?\n", output.c_str());
+        return 1;
+    }
+    std::vector<char> buffer(1 << 20);
+    std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    std::fprintf(file, "Time [s],Sense [V],Command [V],Midori [V],Encoder [counts],Enable,");
+    for (int id = 0; id < channels; ++id) {
+        if (id < (int)labels.size() && !labels[id].empty())
+            std::fprintf(file, "%s,", labels[id].c_str());
+        else
+            std::fprintf(file, "Channel %d,", id);
+    }
+    std::fprintf(file, "\n");
+
+    // second pass: one row per sample (channels that weren't plotted are 0, like the GUI's Export),
+    // gathered into columns a chunk at a time and formatted in parallel
+    std::vector<std::vector<double>> columns(6 + channels);
+    std::vector<const double*> pointers(columns.size());
+    std::int64_t rows = 0;
+    bool ok = true;
+    auto gather = [&](const FrameView& frame) {
+        for (int s = 0; s < frame.samples(); ++s) {
+            SampleRef sample = frame.sample(s);
+            int tick = sample.tick();
+            if (tick < from || tick > to)
+                continue;
+            columns[0].push_back(tick / header.loop_rate);
+            columns[1].push_back(sample.sense());
+            columns[2].push_back(sample.command());
+            columns[3].push_back(sample.midori());
+            columns[4].push_back(sample.encoder());
+            columns[5].push_back(sample.enable());
+            for (int i = 0; i < channels; ++i)
+                columns[6 + i].push_back(i < frame.channels() ? sample.value(i) : 0);
+        }
+    };
+    auto write_chunk = [&]() {
+        for (std::size_t c = 0; c < columns.size(); ++c)
+            pointers[c] = columns[c].data();
+        ok &= csv_write(file, pointers, columns[0].size());
+        rows += columns[0].size();
+        for (auto& column : columns)
+            column.clear();
+    };
+    if (!reader.index().empty()) {
+        for (auto& entry : reader.index()) {
+            if (entry.last_tick < from || entry.first_tick > to)
+                continue;
+            if (reader.seek(entry.offset) && reader.next(chunk) && chunk.type == ChunkFrames && reader.read(chunk, payload)) {
+                RecordingReader::for_each_frame(payload, gather);
+                write_chunk();
+            }
+        }
+    }
+    else {
+        std::printf("%s has no index (the recording wasn't finished), so scanning it.\n", input.c_str());
+        reader.rewind();
+        while (reader.next(chunk)) {
+            if (chunk.type == ChunkFrames && reader.read(chunk, payload)) {
+                RecordingReader::for_each_frame(payload, gather);
+                write_chunk();
+            }
+            else
+                reader.skip();
+        }
+    }
+    ok &= std::fclose(file) == 0;
+    if (!ok) {
+        std::printf("Failed to write %s. Is the disk full?\n", output.c_str());
+        return 1;
+    }
+    std::printf("Wrote %lld rows with %d plot channel(s) to %s.\n", (long long)rows, channels, output.c_str());
+    return 0;
+}
@@ -3,14 +3,13 @@
 template <class Formatter>
 class GuiLogWritter : public Writer {
 public:
-    GuiLogWritter(Severity max_severity = Debug) : Writer(max_severity), l_logs(500), r_logs(500) {}
+    GuiLogWritter(Severity max_severity = Debug) : Writer(max_severity), l_logs(500) {}
 
     virtual void write(const LogRecord& record) override {
         auto log = std::pair<Severity, std::string>(record.get_severity(), Formatter::format(record));
         l_logs.push_back(log);
     }
     LogBuffer l_logs;
-    LogBuffer r_logs;
 };
 
 static GuiLogWritter<TxtFormatter> writer;
@@ -18,58 +17,88 @@ static GuiLogWritter<TxtFormatter> writer;
 //=============================================================================
 
 #define WIDTH 1260
-#define HEIGHT 720
+#define HEIGHT 780
 #ifdef _DEBUG
 #define TITLE "Pendulum GUI - MAHI Lab (Debug)"
 #else
 #define TITLE "Pendulum GUI - MAHI Lab"
 #endif
 
-PendulumGui::PendulumGui() : 
+PendulumGui::PendulumGui(const std::vector<std::string>& rigs, bool shm) : 
     Application(WIDTH,HEIGHT,TITLE,false),
-    m_connected(false),
-    m_queue(2000)
+    m_rig(0),
+    m_shm(shm)
 {
     style_gui();
     if (MahiLogger) {
         MahiLogger->add_writer(&writer);
         MahiLogger->set_max_severity(Debug);
     }
-    auto result = m_udp.bind(CLIENT_UDP);
-    if (result == Socket::Done)
-        LOG(Info) << "Opened UPD socket on port " << m_udp.get_local_port() << ".";
-    else
-        LOG(Error) << "Failed to open UDP socket on port " << m_udp.get_local_port() << ".";
+    for (auto& rig : rigs)
+        add_rig(rig);
+    if (m_rigs.empty())
+        add_rig(fmt::format("{}:{}", SERVER_IP, SERVER_TCP));
     ImGui::DisableViewports();
     ImGui::DisableDocking();
 }
 
 PendulumGui::~PendulumGui() {
-    m_connected = false;
+    // disconnects every rig and joins its threads
+    m_rigs.clear();
+    for (auto& closing : m_closing)
+        closing.thread.join();
+}
+
+void PendulumGui::reap_closing() {
+    // join the threads that have finished releasing their rig, so they don't pile up
+    auto finished = [](Closing& closing) {
+        if (!closing.done->load(std::memory_order_acquire))
+            return false;
+        closing.thread.join();
+        return true;
+    };
+    m_closing.erase(std::remove_if(m_closing.begin(), m_closing.end(), finished), m_closing.end());
+}
+
+void PendulumGui::add_rig(const std::string& endpoint) {
+    auto colon = endpoint.find(':');
+    std::string address = endpoint.substr(0, colon);
+    int port = colon == std::string::npos ? SERVER_TCP : std::atoi(endpoint.c_str() + colon + 1);
+    if (address.empty() || port <= 0 || port > 65535) {
+        LOG(Error) << "Invalid rig \"" << endpoint << "\". Use address[:port].";
+        return;
+    }
+    m_rigs.emplace_back(new Rig(address, (unsigned short)port, m_shm));
+    m_rig = (int)m_rigs.size() - 1;
 }
 
 void PendulumGui::update() {
 
-    ping();
+    // every rig keeps collecting data, not just the one shown
+    for (auto& rig : m_rigs)
+        rig->update();
+    reap_closing();
+    Rig& rig = *m_rigs[m_rig];
 
     constexpr int pad     = 10;
     constexpr int w_left = 250;
     constexpr int h_comm = 190;
-    constexpr int h_stat = 175;
-    constexpr int h_netw = 175;
-    constexpr int w_logs = WIDTH/2-pad-pad/2;
+    constexpr int h_stat = 195;
+    constexpr int h_netw = 217;
+    constexpr int w_time = 330;
+    constexpr int w_logs = (WIDTH - 4*pad - w_time) / 2;
     constexpr int h_logs = HEIGHT - 5*pad - h_comm - h_stat - h_netw;
 
-    ImGui::BeginFixed("Commands", ImVec2(pad,pad), ImVec2(w_left,h_comm), ImGuiWindowFlags_NoCollapse);
-    show_cmds();
+    ImGui::BeginFixed(fmt::format("Commands - {}###Commands", rig.name()).c_str(), ImVec2(pad,pad), ImVec2(w_left,h_comm), ImGuiWindowFlags_NoCollapse);
+    show_cmds(rig);
     ImGui::End();
 
     ImGui::BeginFixed("Controller Status", ImVec2(pad,h_comm+2*pad), ImVec2(w_left,h_stat), ImGuiWindowFlags_NoCollapse);
-    show_status();
+    show_status(rig);
     ImGui::End();
 
     ImGui::BeginFixed("Network Status", ImVec2(pad,h_comm+h_stat+3*pad), ImVec2(w_left, h_netw), ImGuiWindowFlags_NoCollapse);
-    show_network();
+    show_network(rig);
     ImGui::End();
 
     static ImGuiTextFilter l_filter;
@@ -81,174 +110,88 @@ void PendulumGui::update() {
     static ImGuiTextFilter r_filter;
     static bool            r_verb = false;
     ImGui::BeginFixed("Remote Logs", ImVec2(2*pad+w_logs,h_comm+h_stat+h_netw+4*pad), ImVec2(w_logs,h_logs), ImGuiWindowFlags_NoCollapse);
-    show_logs(writer.r_logs,r_filter,r_verb);
+    show_logs(rig.logs(),r_filter,r_verb);
     ImGui::End();
 
-    ImGui::BeginFixed("Data", ImVec2(w_left+2*pad,pad), ImVec2(WIDTH-3*pad-w_left,h_comm+h_stat+h_netw+2*pad), ImGuiWindowFlags_NoCollapse);
-    show_plot();
+    ImGui::BeginFixed("Timing", ImVec2(3*pad+2*w_logs,h_comm+h_stat+h_netw+4*pad), ImVec2(w_time,h_logs), ImGuiWindowFlags_NoCollapse);
+    show_timing(rig);
     ImGui::End();
 
-}
+    ImGui::BeginFixed("Data", ImVec2(w_left+2*pad,pad), ImVec2(WIDTH-3*pad-w_left,h_comm+h_stat+h_netw+2*pad), ImGuiWindowFlags_NoCollapse);
+    show_rigs();
+    show_plot(m_rigs[m_rig]);
+    ImGui::End();
 
-bool PendulumGui::connect() {
-    auto status = m_tcp.connect(SERVER_IP, SERVER_TCP, seconds(0.1));
-    if (status == Socket::Status::Done) {
-        LOG(Info) << "Connected to myRIO: " << m_tcp.get_remote_port() << "@" << m_tcp.get_remote_address();
-        clear_data();
-        m_connected = true;
-        m_data_thread = std::thread(&PendulumGui::data_thread_func, this);
-        m_data_thread.detach();
-        m_msgSent = 0;
-        return true;
-    }
-    else {
-        LOG(Error) << "Failed to connect to myRIO. Ensure that the Pendulum application is running on the myRIO.";
-        m_connected = false;
-        return false;
-    }
 }
 
-bool PendulumGui::ping() {
-    if (m_connected && send_message(Message::Ping)) {
-        Packet packet;
-        auto result = m_tcp.receive(packet);
-        if (result == Socket::Done) {
-            int new_logs;
-            packet >> m_status >> new_logs;
-            for (int i = 0; i < new_logs; ++i) {
-                int sev;
-                std::string msg;
-                packet >> sev >> msg;
-                auto log = std::pair<Severity, std::string>((Severity)sev, msg);
-                writer.r_logs.push_back(log);
+void PendulumGui::show_rigs() {
+    int closed = -1;
+    if (ImGui::BeginTabBar("##Rigs")) {
+        for (int r = 0; r < (int)m_rigs.size(); ++r) {
+            Rig& rig = *m_rigs[r];
+            // the last rig can't be closed
+            bool open = true;
+            ImGui::PushStyleColor(ImGuiCol_Text, rig.connected() ? Blues::DeepSkyBlue : ImGui::GetStyleColorVec4(ImGuiCol_Text));
+            bool selected = ImGui::BeginTabItem(rig.name().c_str(), m_rigs.size() > 1 ? &open : nullptr);
+            ImGui::PopStyleColor();
+            if (selected) {
+                m_rig = r;
+                ImGui::EndTabItem();
             }
-
-            m_connected = true;
-            return true;
-        }
-        else {
-            LOG(Warning) << "Lost connection to myRIO.";
-            m_connected = false;
-            return false;
-        }
-    }
-    return false;
-}
-
-bool PendulumGui::send_message(Message msg) {
-    if (m_connected) {
-        Packet packet;
-        packet << (int)msg;
-        auto result = m_tcp.send(packet);
-        if (result == Socket::Done) {
-            m_msgSent++;
-            return true;
-        }
-        else {
-            LOG(Error) << "Lost connection to myRIO.";
-            m_connected = false;
-            return false;
+            if (!open)
+                closed = r;
         }
-    }
-    return false;
-}
-
-void PendulumGui::data_thread_func() {
-    LOG(Info) << "Starting data streaming thread.";
-    Packet packet;
-    Data data;
-    unsigned short port;
-    IpAddress address;
-    int lastTick = -1;
-    m_packsLost = 0;
-    m_packsRecv = 0;
-    bool keep_alive = true;
-    while (m_connected && keep_alive) {
-        packet.clear();
-        auto result = m_udp.receive(packet, address, port);
-        if (result == Socket::Done) {
-            packet >> data;
-            if (data.state.tick == -1) {
-                keep_alive = false; 
-                break;
-            } 
-            else if (lastTick + 1 != data.state.tick) 
-                m_packsLost++;         
-            m_queue.try_push(data);
-            m_packsRecv++;
-            lastTick = data.state.tick;
+        if (ImGui::TabItemButton("+", ImGuiTabItemFlags_Trailing))
+            ImGui::OpenPopup("Add Rig");
+        if (ImGui::BeginPopup("Add Rig")) {
+            static char address[64] = SERVER_IP;
+            static int  port        = SERVER_TCP;
+            ImGui::SetNextItemWidth(150);
+            ImGui::InputText("Address", address, sizeof(address));
+            ImGui::SetNextItemWidth(150);
+            ImGui::InputInt("Port", &port);
+            if (ImGui::Button("Add", ImVec2(-1,0))) {
+                add_rig(fmt::format("{}:{}", address, port));
+                ImGui::CloseCurrentPopup();
+            }
+            ImGui::EndPopup();
         }
+        ImGui::EndTabBar();
     }
-    LOG(Info) << "Terminated data streaming thread.";
-}
-
-void PendulumGui::clear_data() {
-    m_timeData.clear();
-    m_senseData.clear();
-    m_commandData.clear();
-    m_midoriData.clear();
-    m_encoderData.clear();
-    m_enableData.clear();
-    m_plots.clear();
-}
-
-void PendulumGui::export_data(const std::string& filepath) {
-    std::ofstream file;
-    file.open(filepath);
-    if (!file.is_open())
-    {
-        LOG(Error) << "Failed to open file " << filepath << ". Is it open in another application?";
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(m_data_mtx);
-    // write header
-    file << "Time [s],Sense [V],Command [V],Midori [V],Encoder [counts],Enable,";
-    for (auto& p : m_plots) 
-        file << p.first << ",";
-    file << std::endl;
-    // write data
-    int i = m_timeData.offset;
-    int N = m_timeData.size;
-    for (int n = 0; n < N; ++n) {
-        file << m_timeData.data[i]    << ","
-             << m_senseData.data[i]   << ","
-             << m_commandData.data[i] << ","
-             << m_midoriData.data[i]  << ","
-             << m_encoderData.data[i] << ","
-             << m_enableData.data[i]  << ",";
-        for (auto& p : m_plots)
-            file << p.second.data[i] << ",";
-        file << std::endl;
-        if (++i == N)
-            i = 0;             
+    if (closed != -1) {
+        // the rig joins its threads when released, which mustn't stall the UI
+        std::shared_ptr<Rig> rig = std::move(m_rigs[closed]);
+        m_rigs.erase(m_rigs.begin() + closed);
+        m_rig = std::min(m_rig, (int)m_rigs.size() - 1);
+        auto done = std::make_shared<std::atomic_bool>(false);
+        std::thread thread([rig, done]() mutable {
+            rig.reset();
+            done->store(true, std::memory_order_release);
+        });
+        m_closing.push_back({std::move(thread), done});
     }
-    file.close();
-    LOG(Info) << "Exported data to " << filepath << ".";
 }
 
-void PendulumGui::show_cmds() {
-    ImGui::BeginDisabled(m_connected);
-    if (ImGui::Button("Connect", ImVec2(-1,0))) 
-        connect();    
+void PendulumGui::show_cmds(Rig& rig) {
+    ImGui::BeginDisabled(rig.connected() || rig.connecting());
+    if (ImGui::Button(rig.connecting() ? "Connecting ...###Connect" : "Connect", ImVec2(-1,0))) 
+        rig.connect();    
     ImGui::EndDisabled();
-    ImGui::BeginDisabled(!m_connected || m_status.enabled);
+    ImGui::BeginDisabled(!rig.connected() || rig.status().enabled);
     if (ImGui::Button("Enable", ImVec2(-1,0))) 
-        send_message(Message::Enable);    
+        rig.send_message(Message::Enable);    
     ImGui::EndDisabled();
-    ImGui::BeginDisabled(!m_connected || !m_status.enabled);
+    ImGui::BeginDisabled(!rig.connected() || !rig.status().enabled);
     if (ImGui::Button("Disable", ImVec2(-1,0))) 
-        send_message(Message::Disable);   
+        rig.send_message(Message::Disable);   
     ImGui::EndDisabled();
-    ImGui::BeginDisabled(!m_connected);
+    ImGui::BeginDisabled(!rig.connected());
     if (ImGui::Button("Change Feedback", ImVec2(-1,0))) 
-        send_message(Message::Feedback);    
+        rig.send_message(Message::Feedback);    
     if (ImGui::Button("Zero Encoder", ImVec2(-1,0)))
-        send_message(Message::Zero);
-    if (ImGui::Button("Shutdown", ImVec2(-1,0))) {
-        send_message(Message::Shutdown); 
-        m_status = Status();
-    }
+        rig.send_message(Message::Zero);
+    if (ImGui::Button("Shutdown", ImVec2(-1,0)))
+        rig.send_message(Message::Shutdown); 
     ImGui::EndDisabled();
 }
 
@@ -260,101 +203,117 @@ void info_line(const char* left, const char* right, Color col =  ImGui::GetStyle
     ImGui::PopStyleColor();
 }
 
-void PendulumGui::show_status() {
-    if (m_connected) {
-        info_line("Connected", m_connected ? "True" : "False", m_connected ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
-        info_line("Running", m_status.running ? "True" : "False", m_status.running ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
-        info_line("Enabled", m_status.enabled ? "True" : "False", m_status.enabled ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
-        info_line("Feedback", m_status.mode == (int)Mode::Encoder ? "Enocder" : "Midori");
-        info_line("Loop Rate", fmt::format("{} Hz",m_status.frequency).c_str());
-        info_line("Misses", fmt::format("{}",m_status.misses).c_str());
-        info_line("Wait Ratio", fmt::format("{:.1f}%",m_status.wait*100).c_str());
+void PendulumGui::show_status(Rig& rig) {
+    const Status& status = rig.status();
+    if (rig.connected()) {
+        info_line("Connected", rig.connected() ? "True" : "False", rig.connected() ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
+        info_line("Running", status.running ? "True" : "False", status.running ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
+        info_line("Enabled", status.enabled ? "True" : "False", status.enabled ? Blues::DeepSkyBlue : ImVec4(0.951f, 0.208f, 0.387f, 1.000f));
+        info_line("Feedback", status.mode == (int)Mode::Encoder ? "Enocder" : "Midori");
+        info_line("Loop Rate", fmt::format("{} Hz",status.frequency).c_str());
+        info_line("Misses", fmt::format("{}",status.misses).c_str());
+        info_line("Wait Ratio", fmt::format("{:.1f}%",status.wait*100).c_str());
+        info_line("Dropped", fmt::format("{}",status.dropped).c_str());
     }
     else {
         ImGui::Text("Connect myRIO");
     }
 }
 
-void PendulumGui::show_network() {
-    if (m_connected) {
-        auto defcol = ImGui::GetStyleColorVec4(ImGuiCol_Text);
-        info_line("TCP Local", fmt::format("{}@{}",m_tcp.get_local_port(), CLIENT_IP).c_str());
-        info_line("TCP Remote", fmt::format("{}@{}",m_tcp.get_remote_port(), SERVER_IP).c_str());
-        info_line("UDP Local", fmt::format("{}@{}",CLIENT_UDP, CLIENT_IP).c_str());
-        info_line("UDP Remote", fmt::format("{}@{}",SERVER_UDP, SERVER_IP).c_str());
-        info_line("Sent",fmt::format("{}", m_msgSent).c_str());
-        info_line("Received",fmt::format("{}", m_packsRecv).c_str());
-        info_line("Lost",fmt::format("{}", m_packsLost).c_str());
-        // ImGui::LabelText("Local", "%d@%s", CLIENT_UDP, CLIENT_IP);
-        // ImGui::LabelText("Remote", "%d@%s", SERVER_UDP, SERVER_IP);
-
-        // ImGui::LabelText("Local", "%d@%s", m_tcp.get_local_port(), CLIENT_IP);
-        // ImGui::LabelText("Remote", "%d@%s", m_tcp.get_remote_port(), m_tcp.get_remote_address().to_string());
-        // ImGui::Separator();
-        // ImGui::LabelText("Local", "%d@%s", CLIENT_UDP, CLIENT_IP);
-        // ImGui::LabelText("Remote", "%d@%s", SERVER_UDP, SERVER_IP);
-        // ImGui::LabelText("Packets", "%d / %d", m_packsRecv, m_packsLost);
+void PendulumGui::show_timing(Rig& rig) {
+    static const char* names[PhaseCount] = {"Read", "Control", "Write", "Stream", "Tick"};
+    if (rig.connected()) {
+        if (ImGui::BeginTable("##Timing", 5, ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Phase [us]");
+            ImGui::TableSetupColumn("Min");
+            ImGui::TableSetupColumn("P50");
+            ImGui::TableSetupColumn("P99");
+            ImGui::TableSetupColumn("Max");
+            ImGui::TableHeadersRow();
+            for (int p = 0; p < PhaseCount; ++p) {
+                auto& t = rig.status().timing[p];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(names[p]);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", t.min);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", t.p50);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", t.p99);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", t.max);
+            }
+            ImGui::EndTable();
+        }
+        // what the controller does to keep the loop on time, and the page faults it still takes
+        const Status& status = rig.status();
+        std::string realtime;
+        if (status.realtime & RtFifo)     realtime += "FIFO ";
+        if (status.realtime & RtPinned)   realtime += "Pinned ";
+        if (status.realtime & RtLocked)   realtime += "Locked ";
+        if (status.realtime & RtPrefault) realtime += "Prefault ";
+        ImGui::Text("Real-Time: %s", realtime.empty() ? "None" : realtime.c_str());
+        ImGui::Text("Page Faults: %d", status.faults);
     }
     else {
         ImGui::Text("Connect myRIO");
     }
 }
 
-void PendulumGui::show_plot() {
-
-    static double latestTime = 0;
-    static bool   paused     = false;
-    static std::set<std::string> seen;
-    seen.clear();
-
-    // thread safe section
-    {        
-        std::lock_guard<std::mutex> lock(m_data_mtx);
-        // pop samples of queue
-        while (m_queue.front()) {
-            auto data = *m_queue.front();
-            m_queue.pop();
-            int size   = m_timeData.size;
-            int offset = m_timeData.offset;
-            latestTime = data.state.time;
-            if (!paused) {
-                m_timeData.push_back(latestTime);
-                m_senseData.push_back(data.state.sense);
-                m_commandData.push_back(data.state.command);
-                m_midoriData.push_back(data.state.midori);
-                m_encoderData.push_back(data.state.encoder);
-                m_enableData.push_back(data.state.enable);
-            }
-            // user plots
-            for (auto& p : data.plots) {
-                // flag as having been seen
-                seen.insert(p.label);
-                if (!paused) {
-                    m_plots[p.label].size   = size;
-                    m_plots[p.label].offset = offset;
-                    m_plots[p.label].push_back(p.value);
-                }
-            }
-            // pad unseen plots
-            if (!paused) {
-                for (auto& p : m_plots) {
-                    if (!seen.count(p.first))
-                        p.second.push_back(0);
-                }
-            }             
-        }
+void PendulumGui::show_network(Rig& rig) {
+    if (rig.connected()) {
+        NetworkStats stats = rig.network_stats();
+        // losses on the link are the rig's or the network's; drops are this GUI falling behind
+        Color warn = ImVec4(0.951f, 0.208f, 0.387f, 1.000f);
+        Color text = ImGui::GetStyleColorVec4(ImGuiCol_Text);
+        info_line("TCP Remote", rig.name().c_str());
+        if (rig.via_shm())
+            info_line("Shared Mem.", shm_name(rig.port()).c_str());
+        else
+            info_line("UDP Ports", fmt::format("{} / {}", rig.udp_local_port(), rig.udp_remote_port()).c_str());
+        info_line("Sent", fmt::format("{}", rig.messages_sent()).c_str());
+        info_line("Frames", fmt::format("{} ({} invalid)", stats.frames, stats.invalid).c_str(), stats.invalid ? warn : text);
+        info_line("Samples", fmt::format("{}", stats.samples.received).c_str());
+        info_line("Lost / Late", fmt::format("{} / {}", stats.samples.lost, stats.samples.late).c_str(), stats.samples.lost ? warn : text);
+        info_line("Dup. / Reord.", fmt::format("{} / {}", stats.samples.duplicates, stats.samples.reordered).c_str());
+        info_line("GUI Dropped", fmt::format("{}", stats.dropped).c_str(), stats.dropped ? warn : text);
+        info_line("Jitter [ms]", fmt::format("{:.2f} / {:.2f} / {:.2f}", stats.jitter_p50, stats.jitter_p99, stats.jitter_max).c_str());
+    }
+    else {
+        ImGui::Text("Connect myRIO");
     }
+}
+
+/// Span of a SignalStore column plotted against its Time column.
+struct ColumnGetter {
+    const SignalStore* store;
+    SignalStore::Span  span;
+};
+
+/// ImPlot getter for a ColumnGetter. Unplotted rows are drawn as 0.
+static ImPlotPoint get_column(void* data, int idx) {
+    auto g = (ColumnGetter*)data;
+    double t, v;
+    g->store->point(g->span, idx, t, v);
+    return ImPlotPoint(t, std::isnan(v) ? 0 : v);
+}
+
+void PendulumGui::show_plot(const std::shared_ptr<Rig>& owner) {
+
+    Rig& rig = *owner;
+    double latestTime;
+    {
+        std::lock_guard<std::mutex> lock(rig.data_mutex());
+        latestTime = rig.store().latest_time();
+    }
+    bool paused = rig.paused();
 
     if (ImGui::Button("Clear",ImVec2(100,0))) {
-        clear_data();
+        rig.clear_data();
     }
     ImGui::SameLine();
+    // dialogs hold on to the rig in case its tab is closed meanwhile
     if (ImGui::Button("Export",ImVec2(100,0))) {
-        paused = true;
-        auto sd = [this]() {
+        auto sd = [owner]() {
             std::string path;
             if (save_dialog(path, {{"CSV","csv"}}) == DialogResult::DialogOkay)
-                export_data(path);
+                owner->export_data(path);
         };
         std::thread thrd(sd);
         thrd.detach();
@@ -362,45 +321,84 @@ void PendulumGui::show_plot() {
     ImGui::SameLine();
     if (ImGui::Button(paused ? "Resume" : "Pause",ImVec2(100,0))) {
         if (paused)
-            clear_data();
-        paused = !paused;
+            rig.clear_data();
+        rig.set_paused(!paused);
+    }
+    ImGui::SameLine();
+    if (rig.recorder().recording()) {
+        if (ImGui::Button(fmt::format("Stop {:.0f} MB###Record", rig.recorder().bytes() / 1e6).c_str(), ImVec2(100,0)))
+            rig.recorder().stop();
+    }
+    else {
+        ImGui::BeginDisabled(!rig.connected());
+        if (ImGui::Button("Record###Record",ImVec2(100,0))) {
+            auto sd = [owner]() {
+                std::string path;
+                if (save_dialog(path, {{"Recording","rec"}}) == DialogResult::DialogOkay)
+                    owner->start_recording(path);
+            };
+            std::thread thrd(sd);
+            thrd.detach();
+        }
+        ImGui::EndDisabled();
     }
     static bool show_default = true;
     ImGui::SameLine();
     ImGui::Checkbox("Default Plots",&show_default);
+    static const int histories[] = {10, 30, 60, 300, 600};
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(100);
+    if (ImGui::BeginCombo("History", fmt::format("{} s", rig.history()).c_str())) {
+        for (int h : histories) {
+            if (ImGui::Selectable(fmt::format("{} s", h).c_str(), h == rig.history()))
+                rig.set_history(h);
+        }
+        ImGui::EndCombo();
+    }
 
     ImGui::SameLine(880);
     ImGui::Text("    %.3f FPS", ImGui::GetIO().Framerate);
-    if (!paused && m_connected)
+    if (!paused && rig.connected())
         ImPlot::SetNextPlotLimitsX(latestTime - 10, latestTime, ImGuiCond_Always);
     ImPlot::SetNextPlotLimitsY(-10,10, ImGuiCond_Appearing, ImPlotYAxis_2);
     ImPlot::SetNextPlotLimitsY(-2000,2000,ImGuiCond_Appearing, ImPlotYAxis_3);
     if (ImPlot::BeginPlot("##State", "Time [s]", NULL, ImVec2(-1,-1), show_default ? ImPlotFlags_YAxis2 | ImPlotFlags_YAxis3 : 0, 0, 0, 0, 0, "Voltage [V]", "Counts")) {
-        if (show_default && m_timeData.size > 0) {
+        std::lock_guard<std::mutex> lock(rig.data_mutex());
+        const SignalStore& store = rig.store();
+        // draw only the visible history, at a level of detail that matches the zoom
+        auto limits = ImPlot::GetPlotLimits();
+        int  pixels = (int)ImPlot::GetPlotSize().x;
+        auto getter = [&](int column) { 
+            return ColumnGetter{&store, store.span(column, limits.X.Min, limits.X.Max, pixels)}; 
+        };
+        if (show_default && store.size() > 0) {
+            ColumnGetter enable = getter(SignalStore::Enable), sense = getter(SignalStore::Sense), command = getter(SignalStore::Command);
+            ColumnGetter midori = getter(SignalStore::Midori), encoder = getter(SignalStore::Encoder);
             ImPlot::SetPlotYAxis(ImPlotYAxis_2);
             ImPlot::SetNextFillStyle(Blues::DeepSkyBlue);        
-            ImPlot::PlotDigital("Enable",  &m_timeData.data[0], &m_enableData.data[0], m_timeData.size, m_timeData.offset);
+            ImPlot::PlotDigitalG("Enable", get_column, &enable, enable.span.count);
             ImPlot::SetNextLineStyle(Yellows::Yellow);
-            ImPlot::PlotLine("Sense", &m_timeData.data[0], &m_senseData.data[0], m_timeData.size, m_timeData.offset);
+            ImPlot::PlotLineG("Sense", get_column, &sense, sense.span.count);
             ImPlot::SetNextLineStyle(Oranges::Orange);
-            ImPlot::PlotLine("Command", &m_timeData.data[0], &m_commandData.data[0], m_timeData.size, m_timeData.offset);
+            ImPlot::PlotLineG("Command", get_column, &command, command.span.count);
             ImPlot::SetNextLineStyle(Cyans::LightSeaGreen);
-            ImPlot::PlotLine("Midori", &m_timeData.data[0], &m_midoriData.data[0], m_timeData.size, m_timeData.offset);
+            ImPlot::PlotLineG("Midori", get_column, &midori, midori.span.count);
             ImPlot::SetPlotYAxis(ImPlotYAxis_3);
             ImPlot::SetNextLineStyle(Whites::White);
-            ImPlot::PlotLine("Encoder", &m_timeData.data[0], &m_encoderData.data[0], m_timeData.size, m_timeData.offset);
+            ImPlot::PlotLineG("Encoder", get_column, &encoder, encoder.span.count);
         }
-        if (m_timeData.size > 0) {
+        if (store.size() > 0) {
             ImPlot::SetPlotYAxis(ImPlotYAxis_1);
-            for (auto& p : m_plots) {
-                if (seen.count(p.first))
-                    ImPlot::PlotLine(p.first.c_str(), &m_timeData.data[0], &p.second.data[0], m_timeData.size, m_timeData.offset);
+            for (int id = 0; id < store.channels(); ++id) {
+                if (!store.has_channel(id))
+                    continue;
+                ColumnGetter channel = getter(SignalStore::Channel0 + id);
+                ImPlot::PlotLineG(rig.channel_label(id).c_str(), get_column, &channel, channel.span.count);
             }
         }
         ImPlot::EndPlot();
     }
 }
-
 void PendulumGui::show_logs(LogBuffer& logs, ImGuiTextFilter& filter, bool& verb) {
     static std::unordered_map<Severity, Color> colors = {
         {None, Grays::Gray50},      {Fatal, Reds::Red}, {Error, ImVec4(0.951f, 0.208f, 0.387f, 1.000f)},
@@ -1,66 +1,43 @@
 #include <Mahi/Gui.hpp>
 #include <Mahi/Com.hpp>
-#include "Common.hpp"
+#include "common.hpp"
+#include "Rig.hpp"
+#include <memory>
+#include <string>
 #include <thread>
-#include <mutex>
+#include <vector>
+#include <algorithm>
 #include <atomic>
-
-#define MAX_SAMPLES 20000
+#include <cmath>
 
 using namespace mahi::gui;
 
-struct DataBuffer {    
-    void push_back(double v) {
-        if (size < MAX_SAMPLES) {
-            data[size++] = v;       
-        } 
-        else {
-            data[offset] = v;
-            offset       = (offset + 1) % MAX_SAMPLES;
-        }
-    }
-    void clear() { size = offset = 0; }
-public:
-    int    size              = 0;
-    int    offset            = 0;
-    double data[MAX_SAMPLES] = {0};
-};
-
 class PendulumGui : public Application {
 public:
-    PendulumGui();
+    /// Constructor. Monitors each rig given as "address[:port]", or the default myRIO if none are.
+    /// With shm, rigs on this host started with --shm stream telemetry through shared memory.
+    PendulumGui(const std::vector<std::string>& rigs = {}, bool shm = false);
     ~PendulumGui();
 private:
     void update() override;
-    bool connect();
-    bool ping();
-    bool send_message(Message msg);
-    void data_thread_func();
-    void clear_data();
-    void export_data(const std::string& filepath);
-    void show_network();
+    void add_rig(const std::string& endpoint);
+    void show_network(Rig& rig);
     void show_logs(LogBuffer& logs, ImGuiTextFilter& filter, bool& verb);
-    void show_cmds();
-    void show_status();
-    void show_plot();
+    void show_cmds(Rig& rig);
+    void show_status(Rig& rig);
+    void show_timing(Rig& rig);
+    void show_rigs();
+    void show_plot(const std::shared_ptr<Rig>& owner);
     void style_gui();
+    void reap_closing();
 private:
-    TcpSocket             m_tcp;
-    UdpSocket             m_udp;
-    std::atomic_bool      m_connected;
-    std::mutex            m_data_mtx;
-    Status                m_status;
-    std::thread           m_data_thread;
-    int                   m_msgSent   = 0;
-    int                   m_packsRecv = 0;
-    int                   m_packsLost = 0;
-private:
-    SPSCQueue<Data> m_queue;
-    DataBuffer      m_timeData;
-    DataBuffer      m_senseData;
-    DataBuffer      m_commandData;
-    DataBuffer      m_midoriData;
-    DataBuffer      m_encoderData;
-    DataBuffer      m_enableData;
-    std::map<std::string,DataBuffer> m_plots;
+    /// A thread releasing a rig whose tab was closed.
+    struct Closing {
+        std::thread                       thread; ///< releases the rig
+        std::shared_ptr<std::atomic_bool> done;   ///< set by the thread once the rig is released
+    };
+    std::vector<std::shared_ptr<Rig>> m_rigs; // every rig monitored (shared with open file dialogs)
+    int                               m_rig;  // the rig shown in the side panels
+    bool                              m_shm;  // read telemetry of rigs on this host from shared memory?
+    std::vector<Closing>              m_closing; // threads releasing rigs whose tabs were closed
 };
@@ -0,0 +1,173 @@
+#include "Recorder.hpp"
+#include <Mahi/Util.hpp>  // for LOG
+#include <algorithm>      // for std::max, std::min
+#include <cstring>        // for std::memcpy
+
+using namespace mahi::util;
+
+Recorder::Recorder(std::size_t chunk_bytes) :
+    m_chunk_bytes(chunk_bytes),
+    m_file(nullptr),
+    m_recording(false),
+    m_stop(false),
+    m_bytes(0),
+    m_frames(0)
+{ }
+
+Recorder::~Recorder() {
+    stop();
+}
+
+bool Recorder::start(const std::string& path, const RecordingHeader& header) {
+    std::lock_guard<std::mutex> control(m_control_mtx);
+    finish();
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        LOG(Error) << "Failed to open recording " << path << ".";
+        return false;
+    }
+    unsigned char b[REC_HEADER_BYTES];
+    rec_put(b, header);
+    std::fwrite(b, 1, REC_HEADER_BYTES, m_file);
+    m_index.clear();
+    m_bytes  = REC_HEADER_BYTES;
+    m_frames = 0;
+    m_stop   = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_fill = make_chunk(ChunkFrames);
+    }
+    m_writer = std::thread(&Recorder::writer_thread_func, this);
+    m_recording = true;
+    LOG(Info) << "Recording to " << path << ".";
+    return true;
+}
+
+void Recorder::stop() {
+    std::lock_guard<std::mutex> control(m_control_mtx);
+    finish();
+}
+
+void Recorder::finish() {
+    if (!m_recording)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_recording = false;
+        submit();
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_writer.join();
+    // index every frames chunk, then point the trailer at the index
+    ChunkHeader chunk;
+    chunk.type  = ChunkIndex;
+    chunk.count = (int)m_index.size();
+    chunk.size  = m_index.size() * REC_INDEX_BYTES;
+    std::vector<unsigned char> bytes(REC_CHUNK_BYTES + (std::size_t)chunk.size + REC_TRAILER_BYTES);
+    rec_put(&bytes[0], chunk);
+    for (std::size_t i = 0; i < m_index.size(); ++i)
+        rec_put(&bytes[REC_CHUNK_BYTES + i * REC_INDEX_BYTES], m_index[i]);
+    unsigned char* trailer = &bytes[REC_CHUNK_BYTES + (std::size_t)chunk.size];
+    wire_put<std::uint64_t>(trailer + 0, m_bytes);
+    wire_put<std::uint32_t>(trailer + 8, REC_TRAILER);
+    wire_put<std::uint32_t>(trailer + 12, 0);
+    std::fwrite(bytes.data(), 1, bytes.size(), m_file);
+    m_bytes += bytes.size();
+    std::fclose(m_file);
+    m_file = nullptr;
+    LOG(Info) << "Recorded " << m_frames.load() << " frames (" << m_bytes.load() / 1000000.0 << " MB).";
+}
+
+void Recorder::write_frame(const FrameView& frame, const unsigned char* data) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_recording)
+        return;
+    Chunk& chunk = *m_fill;
+    int first = frame.samples() > 0 ? frame.sample(0).tick() : 0;
+    int last  = frame.samples() > 0 ? frame.sample(frame.samples() - 1).tick() : 0;
+    if (chunk.header.count == 0)
+        chunk.header.first_tick = first;
+    if (last != -1)
+        chunk.last_tick = last;
+    chunk.header.count++;
+    chunk.header.channels = std::max(chunk.header.channels, frame.channels());
+    std::size_t pos = chunk.bytes.size();
+    chunk.bytes.resize(pos + 4 + frame.size());
+    wire_put<std::uint32_t>(&chunk.bytes[pos], (std::uint32_t)frame.size());
+    std::memcpy(&chunk.bytes[pos + 4], data, frame.size());
+    m_frames++;
+    if (chunk.bytes.size() >= m_chunk_bytes) {
+        submit();
+        m_cv.notify_one();
+    }
+}
+
+void Recorder::write_labels(int first, const std::vector<std::string>& labels) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_recording || labels.empty())
+        return;
+    auto chunk = make_chunk(ChunkLabels);
+    for (std::size_t i = 0; i < labels.size(); ++i) {
+        std::size_t pos = chunk->bytes.size();
+        std::uint16_t length = (std::uint16_t)std::min<std::size_t>(labels[i].size(), 0xFFFF);
+        chunk->bytes.resize(pos + 6 + length);
+        wire_put<std::uint32_t>(&chunk->bytes[pos], (std::uint32_t)(first + i));
+        wire_put<std::uint16_t>(&chunk->bytes[pos + 4], length);
+        std::memcpy(&chunk->bytes[pos + 6], labels[i].data(), length);
+    }
+    chunk->header.count = (int)labels.size();
+    m_pending.push_back(std::move(chunk));
+    m_cv.notify_one();
+}
+
+void Recorder::submit() {
+    if (m_fill && m_fill->header.count > 0) {
+        m_pending.push_back(std::move(m_fill));
+        m_fill = make_chunk(ChunkFrames);
+    }
+}
+
+std::unique_ptr<Recorder::Chunk> Recorder::make_chunk(int type) {
+    std::unique_ptr<Chunk> chunk;
+    if (!m_free.empty()) {
+        chunk = std::move(m_free.front());
+        m_free.pop_front();
+    }
+    else {
+        chunk.reset(new Chunk());
+        chunk->bytes.reserve(m_chunk_bytes + 4 + UdpSocket::MaxDatagramSize);
+    }
+    chunk->header = ChunkHeader();
+    chunk->header.type = type;
+    chunk->last_tick = 0;
+    chunk->bytes.resize(REC_CHUNK_BYTES);
+    return chunk;
+}
+
+void Recorder::writer_thread_func() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+        if (m_pending.empty() && m_stop)
+            break;
+        auto chunk = std::move(m_pending.front());
+        m_pending.pop_front();
+        lock.unlock();
+        // one large write per chunk, outside the lock
+        chunk->header.size = chunk->bytes.size() - REC_CHUNK_BYTES;
+        rec_put(&chunk->bytes[0], chunk->header);
+        if (chunk->header.type == ChunkFrames) {
+            IndexEntry entry;
+            entry.offset     = m_bytes;
+            entry.first_tick = chunk->header.first_tick;
+            entry.last_tick  = chunk->last_tick;
+            m_index.push_back(entry);
+        }
+        if (std::fwrite(chunk->bytes.data(), 1, chunk->bytes.size(), m_file) != chunk->bytes.size())
+            LOG(Error) << "Failed to write recording. Is the disk full?";
+        m_bytes += chunk->bytes.size();
+        lock.lock();
+        m_free.push_back(std::move(chunk));
+    }
+}
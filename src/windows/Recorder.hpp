@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Recording.hpp"       // for ChunkHeader, IndexEntry
+#include <atomic>              // for std::atomic
+#include <chrono>              // for std::chrono::system_clock
+#include <condition_variable>  // for std::condition_variable
+#include <deque>               // for std::deque
+#include <memory>              // for std::unique_ptr
+#include <mutex>               // for std::mutex
+#include <thread>              // for std::thread
+
+/// Losslessly records every telemetry frame the GUI receives to a chunked
+/// binary file (see Recording.hpp). Frames are appended to an in-memory chunk
+/// on the data thread; full chunks are handed to a writer thread, which writes
+/// each with a single large write, so neither the data nor the UI thread ever
+/// waits on the disk.
+class Recorder {
+public:
+    /// Constructor. Frames are written in chunks of about chunk_bytes.
+    Recorder(std::size_t chunk_bytes = 1 << 20);
+    /// Destructor. Finishes any recording in progress.
+    ~Recorder();
+    /// Starts recording to a new file, finishing any recording in progress. Returns false if it couldn't be created.
+    bool start(const std::string& path, const RecordingHeader& header);
+    /// Flushes every frame, writes the index and closes the file. start() and stop() may be called from any thread.
+    void stop();
+    /// Is a recording in progress?
+    bool recording() const { return m_recording; }
+    /// Appends a validated telemetry frame (data thread).
+    void write_frame(const FrameView& frame, const unsigned char* data);
+    /// Appends plot channel labels first, first+1, ... (any thread).
+    void write_labels(int first, const std::vector<std::string>& labels);
+    /// The number of bytes written to the file so far.
+    std::uint64_t bytes() const { return m_bytes; }
+    /// The number of frames recorded so far.
+    std::uint64_t frames() const { return m_frames; }
+private:
+    /// A chunk being filled or waiting to be written.
+    struct Chunk {
+        ChunkHeader                header;
+        int                        last_tick = 0;
+        std::vector<unsigned char> bytes; // chunk header and payload
+    };
+    /// Hands the chunk being filled to the writer thread. Call with m_mtx locked.
+    void submit();
+    /// Returns an empty chunk of a type, reusing a written one if possible. Call with m_mtx locked.
+    std::unique_ptr<Chunk> make_chunk(int type);
+    /// Finishes the recording in progress, if any. Call with m_control_mtx locked.
+    void finish();
+    /// The function run by the writer thread.
+    void writer_thread_func();
+private:
+    std::size_t                        m_chunk_bytes; // target chunk size
+    std::FILE*                         m_file;        // the recording
+    std::thread                        m_writer;      // thread writing chunks to m_file
+    std::mutex                         m_control_mtx; // serializes start() and stop() (UI, data and dialog threads)
+    std::mutex                         m_mtx;         // guards the chunk queues
+    std::condition_variable            m_cv;          // signals the writer thread
+    std::unique_ptr<Chunk>             m_fill;        // frames chunk being filled
+    std::deque<std::unique_ptr<Chunk>> m_pending;     // chunks waiting to be written
+    std::deque<std::unique_ptr<Chunk>> m_free;        // written chunks ready to be reused
+    std::vector<IndexEntry>            m_index;       // frames chunks written (writer thread)
+    std::atomic_bool                   m_recording;   // is a recording in progress?
+    bool                               m_stop;        // tells the writer thread to finish (guarded by m_mtx)
+    std::atomic<std::uint64_t>         m_bytes;       // bytes written
+    std::atomic<std::uint64_t>         m_frames;      // frames recorded
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "common.hpp"  // for State
+#include <cstdint>     // for std::int64_t
+#include <cstring>     // for std::memcpy
+#include <memory>      // for std::unique_ptr
+#include <vector>      // for std::vector
+
+/// Sample counts kept by a ReorderBuffer.
+struct ReorderStats {
+    std::int64_t received   = 0; ///< samples released in order
+    std::int64_t lost       = 0; ///< samples skipped that never arrived
+    std::int64_t late       = 0; ///< samples that arrived after they were skipped
+    std::int64_t duplicates = 0; ///< samples that arrived more than once
+    std::int64_t reordered  = 0; ///< samples that arrived after a later one but were put back in order
+};
+
+/// Puts streamed samples back in tick order. Samples are keyed on their
+/// stream step (tick / decimation) and held in a window of that many steps.
+/// A gap is waited for until the sample after it has been held for hold
+/// seconds (or the window fills), then skipped and counted lost. A skipped
+/// sample that turns up afterwards is counted late instead.
+class ReorderBuffer {
+public:
+    /// Constructor. Preallocates window samples of up to channels values.
+    ReorderBuffer(int window, int channels, double hold) :
+        m_window(window), m_channels(channels), m_hold(hold),
+        m_slots(window), m_values(new double[(std::size_t)window * channels]), m_delivered(window, 0)
+    {
+        reset();
+    }
+
+    /// Forgets every held sample and the stream position, but not the counts.
+    void reset() {
+        for (auto& slot : m_slots)
+            slot.step = -1;
+        m_next     = -1;
+        m_newest   = -1;
+        m_buffered = 0;
+    }
+
+    /// Adds a sample received at time now [s] and releases every sample that
+    /// is now in order by calling fn(state, values, count).
+    template <typename Fn>
+    void push(const State& state, const double* values, int count, int decimation, double now, Fn fn) {
+        std::int64_t step = state.tick / (decimation > 0 ? decimation : 1);
+        if (m_next == -1)
+            m_next = step;
+        if (step < m_next) {
+            // already released or skipped; the history only reaches back one window
+            if (step >= m_next - m_window && m_delivered[index(step)]) {
+                m_stats.duplicates++;
+            }
+            else {
+                m_stats.late++;
+                if (step >= m_next - m_window) {
+                    m_stats.lost--;
+                    m_delivered[index(step)] = 1;
+                }
+            }
+            return;
+        }
+        // make room by skipping whatever hasn't arrived a window behind this sample
+        while (step >= m_next + m_window)
+            advance(fn);
+        Slot& slot = m_slots[index(step)];
+        if (slot.step == step) {
+            m_stats.duplicates++;
+            return;
+        }
+        if (step < m_newest)
+            m_stats.reordered++;
+        else
+            m_newest = step;
+        slot.step    = step;
+        slot.state   = state;
+        slot.count   = count < m_channels ? count : m_channels;
+        slot.arrival = now;
+        if (slot.count > 0)
+            std::memcpy(&m_values[index(step) * m_channels], values, slot.count * sizeof(double));
+        m_buffered++;
+        release(now, fn);
+    }
+
+    /// Releases every sample that is in order at time now [s], skipping gaps
+    /// that have been waited on for long enough. Call when nothing has arrived
+    /// for a while, or with an infinite now to release everything.
+    template <typename Fn>
+    void release(double now, Fn fn) {
+        while (m_buffered > 0) {
+            if (m_slots[index(m_next)].step == m_next) {
+                advance(fn);
+                continue;
+            }
+            // a gap: find the sample after it and wait until it has been held long enough
+            std::int64_t after = m_next + 1;
+            while (m_slots[index(after)].step != after)
+                after++;
+            if (now - m_slots[index(after)].arrival < m_hold)
+                break;
+            while (m_next < after)
+                advance(fn);
+        }
+    }
+
+    /// The sample counts so far.
+    const ReorderStats& stats() const { return m_stats; }
+    /// The number of samples held back waiting for a gap.
+    int buffered() const { return m_buffered; }
+
+private:
+    /// A held sample.
+    struct Slot {
+        std::int64_t step;    // stream step, or -1 if empty
+        State        state;   // the sample
+        int          count;   // values in m_values
+        double       arrival; // when it arrived [s]
+    };
+
+    /// Returns the slot (and history) index of a stream step.
+    std::size_t index(std::int64_t step) const { return (std::size_t)(step % m_window); }
+
+    /// Releases the sample at m_next, or skips it if it hasn't arrived.
+    template <typename Fn>
+    void advance(Fn fn) {
+        std::size_t i = index(m_next);
+        Slot& slot = m_slots[i];
+        if (slot.step == m_next) {
+            fn(slot.state, &m_values[i * m_channels], slot.count);
+            slot.step = -1;
+            m_buffered--;
+            m_delivered[i] = 1;
+            m_stats.received++;
+        }
+        else {
+            m_delivered[i] = 0;
+            m_stats.lost++;
+        }
+        m_next++;
+    }
+
+    const int                 m_window;    // stream steps held
+    const int                 m_channels;  // values per slot
+    const double              m_hold;      // how long a gap is waited on [s]
+    std::vector<Slot>         m_slots;     // held samples indexed by step % m_window
+    std::unique_ptr<double[]> m_values;    // values of the held samples
+    std::vector<char>         m_delivered; // was each of the last m_window steps released (1) or skipped (0)?
+    std::int64_t              m_next;      // the next step to release
+    std::int64_t              m_newest;    // the newest step received
+    int                       m_buffered;  // samples held
+    ReorderStats              m_stats;     // sample counts
+};
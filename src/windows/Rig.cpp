@@ -0,0 +1,474 @@
+#include "Rig.hpp"
+#include "Frame.hpp"      // for FrameView
+#include "Csv.hpp"        // for csv_write
+#include "Histogram.hpp"  // for Histogram
+#include <algorithm>      // for std::max, std::min
+#include <chrono>         // for std::chrono::system_clock, std::chrono::milliseconds
+#include <cmath>          // for std::abs, std::isnan
+#include <cstdio>         // for std::FILE
+#include <limits>         // for std::numeric_limits
+
+Rig::Rig(const std::string& address, unsigned short port, bool shm) :
+    m_address(address),
+    m_port(port),
+    m_connected(false),
+    m_connecting(false),
+    m_msgSent(0),
+    m_udp_remote(0),
+    m_shm(shm),
+    m_via_shm(false),
+    m_logs(500),
+    m_queue(2000, GUI_MAX_CHANNELS)
+{
+    auto result = m_udp.bind(Socket::AnyPort);
+    if (result == Socket::Done)
+        LOG(Info) << "Opened UPD socket on port " << m_udp.get_local_port() << " for " << name() << ".";
+    else
+        LOG(Error) << "Failed to open UDP socket for " << name() << ".";
+}
+
+Rig::~Rig() {
+    // let a connection attempt finish so the I/O thread sees the disconnect
+    while (m_connecting)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    m_connected = false;
+    if (m_io_thread.joinable())
+        m_io_thread.join();
+    if (m_data_thread.joinable())
+        m_data_thread.join();
+}
+
+bool Rig::connect() {
+    if (m_connecting)
+        return false;
+    // the previous threads exit as soon as the connection drops
+    if (m_io_thread.joinable())
+        m_io_thread.join();
+    if (m_data_thread.joinable())
+        m_data_thread.join();
+    if (m_recorder.recording()) {
+        LOG(Info) << "Finishing the recording of the previous session.";
+        m_recorder.stop();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_io_mtx);
+        m_requests.clear();
+        m_io_status = Status();
+    }
+    m_status     = Status();
+    m_connecting = true;
+    m_io_thread  = std::thread(&Rig::io_thread_func, this);
+    return true;
+}
+
+bool Rig::handshake() {
+    Packet packet;
+    // UDP port 0 tells the rig we read its shared memory instead
+    unsigned short udp_port = m_via_shm ? 0 : m_udp.get_local_port();
+    packet << (int)Message::Hello << (int)PROTOCOL_VERSION << udp_port;
+    if (m_tcp.send(packet) != Socket::Done) {
+        LOG(Error) << "Lost connection to myRIO " << name() << ".";
+        return false;
+    }
+    // an older myRIO ignores Message::Hello, so don't wait on it forever
+    SocketSelector selector;
+    selector.add(m_tcp);
+    packet.clear();
+    if (!selector.wait(seconds(1)) || m_tcp.receive(packet) != Socket::Done) {
+        LOG(Error) << "myRIO " << name() << " did not answer the handshake, so it speaks a protocol older than version " << PROTOCOL_VERSION << ". Please update it.";
+        return false;
+    }
+    int msg;
+    Handshake hello;
+    packet >> msg >> hello;
+    if (msg != Message::Hello || hello.version != PROTOCOL_VERSION) {
+        LOG(Error) << "myRIO " << name() << " speaks protocol version " << hello.version << " but this GUI speaks version " << PROTOCOL_VERSION << ".";
+        return false;
+    }
+    LOG(Info) << "myRIO " << name() << " is running at " << hello.loop_rate << " Hz and streaming every " << hello.decimation << " tick(s).";
+    std::lock_guard<std::mutex> lock(m_io_mtx);
+    m_hello = hello;
+    return true;
+}
+
+Handshake Rig::hello() const {
+    std::lock_guard<std::mutex> lock(m_io_mtx);
+    return m_hello;
+}
+
+bool Rig::send_message(Message msg) {
+    if (!m_connected)
+        return false;
+    if (msg == Message::Shutdown)
+        m_status = Status();
+    std::lock_guard<std::mutex> lock(m_io_mtx);
+    m_requests.push_back(msg);
+    return true;
+}
+
+bool Rig::send_packet(Packet& packet) {
+    if (m_tcp.send(packet) != Socket::Done) {
+        LOG(Error) << "Lost connection to myRIO " << name() << ".";
+        m_connected = false;
+        return false;
+    }
+    m_msgSent++;
+    return true;
+}
+
+void Rig::update() {
+    std::vector<std::pair<Severity, std::string>> logs;
+    {
+        std::lock_guard<std::mutex> lock(m_io_mtx);
+        if (m_connected)
+            m_status = m_io_status;
+        logs.swap(m_io_logs);
+    }
+    for (auto& log : logs)
+        m_logs.push_back(log);
+    // move received samples into the store
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    SampleView data;
+    while (m_queue.front(data)) {
+        if (!m_paused)
+            m_store.push(*data.state, data.values, data.count);
+        m_queue.pop();
+    }
+}
+
+void Rig::io_thread_func() {
+    // connect and handshake here so a slow or missing myRIO never stalls the UI
+    if (m_tcp.connect(m_address, m_port, seconds(0.1)) != Socket::Done) {
+        LOG(Error) << "Failed to connect to myRIO " << name() << ". Ensure that the Pendulum application is running on the myRIO.";
+        m_connecting = false;
+        return;
+    }
+    LOG(Info) << "Connected to myRIO " << name() << ".";
+    // a rig on this host started with --shm has created its ring by the time it accepts connections
+    m_ring.close();
+    m_via_shm = false;
+    if (m_shm) {
+        bool local = m_address == "localhost" || m_address.compare(0, 4, "127.") == 0;
+        m_via_shm = local && m_ring.open(shm_name(m_port));
+        if (m_via_shm)
+            LOG(Info) << "Reading telemetry from shared memory " << m_ring.name() << ".";
+        else
+            LOG(Warning) << "No shared memory telemetry from " << name() << " (it must run on this host with --shm), so using UDP.";
+    }
+    if (!handshake()) {
+        m_tcp.disconnect();
+        m_connecting = false;
+        return;
+    }
+    set_history(m_history);
+    {
+        std::lock_guard<std::mutex> lock(m_data_mtx);
+        m_channels.clear();
+    }
+    m_msgSent     = 0;
+    m_connected   = true;
+    m_connecting  = false;
+    m_data_thread = std::thread(&Rig::data_thread_func, this);
+    LOG(Info) << "Starting control I/O thread.";
+    // the myRIO pushes Status and logs from here on, so there is nothing to poll
+    Packet packet;
+    packet << (int)Message::Subscribe;
+    send_packet(packet);
+    std::vector<Message> requests;
+    bool labeling = false;       // a Channels request is awaiting its reply
+    std::uint32_t log_seq = 0;   // sequence number of the next remote log record expected
+    std::uint32_t status_seq = 0; // sequence number of the latest Update applied
+    bool has_status = false;     // has an Update been applied yet?
+    SocketSelector selector;
+    selector.add(m_tcp);
+    while (m_connected) {
+        // send queued commands without waiting for replies
+        {
+            std::lock_guard<std::mutex> lock(m_io_mtx);
+            requests.swap(m_requests);
+        }
+        for (auto msg : requests) {
+            packet.clear();
+            packet << (int)msg;
+            if (!send_packet(packet))
+                break;
+        }
+        requests.clear();
+        if (!m_connected || !selector.wait(milliseconds(1)))
+            continue;
+        packet.clear();
+        if (m_tcp.receive(packet) != Socket::Done) {
+            LOG(Warning) << "Lost connection to myRIO " << name() << ".";
+            m_connected = false;
+            break;
+        }
+        int msg;
+        packet >> msg;
+        if (msg == Message::Update) {
+            std::uint32_t seq;
+            Status status;
+            packet >> seq >> status;
+            // replies repeat the latest push's number, so anything not newer is already known
+            std::int32_t ahead = (std::int32_t)(seq - status_seq);
+            if (has_status && ahead <= 0)
+                continue;
+            if (has_status && ahead > 1)
+                LOG(Warning) << "Missed " << ahead - 1 << " status update(s) from " << name() << ".";
+            status_seq = seq;
+            has_status = true;
+            {
+                std::lock_guard<std::mutex> lock(m_io_mtx);
+                m_io_status = status;
+            }
+            // resolve any plot channels we haven't seen labels for yet
+            int known;
+            {
+                std::lock_guard<std::mutex> lock(m_data_mtx);
+                known = (int)m_channels.size();
+            }
+            if (!labeling && status.channels > known) {
+                packet.clear();
+                packet << (int)Message::Channels << known;
+                labeling = send_packet(packet);
+            }
+        }
+        else if (msg == Message::Logs) {
+            std::uint32_t first;
+            int count;
+            packet >> first >> count;
+            if (first != log_seq)
+                LOG(Warning) << "Missed " << (int)(first - log_seq) << " log record(s) from " << name() << ".";
+            log_seq = first + (std::uint32_t)count;
+            std::lock_guard<std::mutex> lock(m_io_mtx);
+            for (int i = 0; i < count; ++i) {
+                int sev;
+                std::string text;
+                packet >> sev >> text;
+                m_io_logs.push_back(std::make_pair((Severity)sev, text));
+            }
+        }
+        else if (msg == Message::Channels) {
+            int first, count;
+            packet >> first >> count;
+            std::vector<std::string> labels(count);
+            for (auto& label : labels)
+                packet >> label;
+            {
+                std::lock_guard<std::mutex> lock(m_data_mtx);
+                m_channels.resize(first);
+                for (int i = 0; i < count; ++i) {
+                    m_channels.push_back(labels[i]);
+                    LOG(Verbose) << "Plot channel " << first + i << " is \"" << labels[i] << "\".";
+                }
+            }
+            m_recorder.write_labels(first, labels);
+            labeling = false;
+        }
+    }
+    m_tcp.disconnect();
+    LOG(Info) << "Terminated control I/O thread.";
+}
+
+void Rig::data_thread_func() {
+    LOG(Info) << "Starting data streaming thread.";
+    double loop_rate = hello().loop_rate;
+    std::size_t capacity = std::max<std::size_t>(UdpSocket::MaxDatagramSize, m_via_shm ? m_ring.slot_bytes() : 0);
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[capacity]);
+    std::size_t received;
+    FrameView frame;
+    State state;
+    double values[GUI_MAX_CHANNELS];
+    unsigned short port;
+    IpAddress address;
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mtx);
+        m_stats = NetworkStats();
+    }
+    NetworkStats stats;
+    // samples go through a reorder window keyed on tick before reaching the UI
+    ReorderBuffer reorder(REORDER_WINDOW, GUI_MAX_CHANNELS, REORDER_HOLD);
+    auto deliver = [&](const State& s, const double* v, int count) {
+        if (!m_queue.try_push(s, v, count))
+            stats.dropped++;
+    };
+    // RFC 3550 inter-arrival jitter of frames: the change in transit time between
+    // consecutive frames, where a frame is sent at the time of its first tick
+    Histogram jitter;
+    Clock clock;
+    double last_transit = std::numeric_limits<double>::quiet_NaN();
+    double last_publish = 0;
+    bool keep_alive = true;
+    bool truncated  = false;
+    // frames arrive the same way over UDP and shared memory
+    auto handle = [&](std::size_t size, double now) {
+        auto parsed = frame.parse(buffer.get(), size);
+        if (parsed != FrameView::Ok) {
+            if (stats.invalid++ == 0)
+                LOG(Warning) << "Discarding invalid telemetry frame (error " << (int)parsed << ").";
+            return;
+        }
+        stats.frames++;
+        if (m_recorder.recording())
+            m_recorder.write_frame(frame, buffer.get());
+        if (frame.samples() > 0 && frame.sample(0).tick() != -1) {
+            double transit = now - frame.sample(0).tick() / loop_rate;
+            if (!std::isnan(last_transit))
+                jitter.record((std::uint64_t)(std::abs(transit - last_transit) * 1e6));
+            last_transit = transit;
+        }
+        // read every sample batched into this frame in place
+        int decimation = std::max(frame.decimation(), 1);
+        int channels   = std::min(frame.channels(), GUI_MAX_CHANNELS);
+        if (frame.channels() > channels && !truncated) {
+            LOG(Warning) << name() << " plots " << frame.channels() << " channels, but the GUI only keeps the first " << channels << ".";
+            truncated = true;
+        }
+        for (int s = 0; s < frame.samples(); ++s) {
+            SampleRef sample = frame.sample(s);
+            state.tick = sample.tick();
+            if (state.tick == -1) {
+                keep_alive = false;
+                break;
+            }
+            state.time    = state.tick / loop_rate;
+            state.sense   = sample.sense();
+            state.command = sample.command();
+            state.midori  = sample.midori();
+            state.encoder = sample.encoder();
+            state.enable  = sample.enable();
+            for (int i = 0; i < channels; ++i)
+                values[i] = sample.value(i);
+            reorder.push(state, values, channels, decimation, now, deliver);
+        }
+    };
+    // frames the rig overwrote in shared memory before we read them (their samples count as lost)
+    std::int64_t overwritten = 0;
+    // wake up now and then to notice a disconnect and release held samples
+    SocketSelector selector;
+    selector.add(m_udp);
+    while (m_connected && keep_alive) {
+        double now = clock.get_elapsed_time().as_seconds();
+        if (m_via_shm) {
+            // drain the ring without a syscall, sleeping only once it is empty
+            bool idle = true;
+            while (keep_alive && m_ring.read(buffer.get(), received, overwritten)) {
+                now = clock.get_elapsed_time().as_seconds();
+                handle(received, now);
+                idle = false;
+            }
+            if (idle)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        else if (selector.wait(milliseconds(10)) && m_udp.receive(buffer.get(), UdpSocket::MaxDatagramSize, received, address, port) == Socket::Done) {
+            now = clock.get_elapsed_time().as_seconds();
+            m_udp_remote = port;
+            handle(received, now);
+        }
+        // the stream stopped, so nothing still missing will arrive
+        reorder.release(keep_alive ? now : std::numeric_limits<double>::infinity(), deliver);
+        stats.samples = reorder.stats();
+        if (now - last_publish >= 1) {
+            stats.jitter_p50 = jitter.percentile(0.5) / 1000;
+            stats.jitter_p99 = jitter.percentile(0.99) / 1000;
+            stats.jitter_max = jitter.max() / 1000.0;
+            jitter.clear();
+            last_publish = now;
+        }
+        std::lock_guard<std::mutex> lock(m_stats_mtx);
+        m_stats = stats;
+    }
+    auto& s = stats.samples;
+    LOG(Info) << "Terminated data streaming thread. Received " << s.received << " samples in " << stats.frames << " frames; "
+              << s.lost << " lost, " << s.late << " late, " << s.duplicates << " duplicated, " << s.reordered << " reordered, "
+              << stats.dropped << " dropped by the GUI.";
+    if (overwritten)
+        LOG(Warning) << overwritten << " frame(s) were overwritten in shared memory before the GUI read them.";
+}
+
+NetworkStats Rig::network_stats() const {
+    std::lock_guard<std::mutex> lock(m_stats_mtx);
+    return m_stats;
+}
+
+void Rig::clear_data() {
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    m_store.clear();
+}
+
+void Rig::set_history(int seconds) {
+    // size the store for the stream rate of the connected myRIO
+    Handshake link = hello();
+    double rate = link.loop_rate > 0 ? link.loop_rate / std::max(link.decimation, 1) : 1000;
+    std::lock_guard<std::mutex> lock(m_data_mtx);
+    m_history = seconds;
+    m_store.set_capacity((std::size_t)(seconds * rate));
+    LOG(Verbose) << "Keeping " << seconds << " s of history (" << m_store.capacity() << " samples).";
+}
+
+void Rig::export_data(const std::string& filepath) {
+    std::FILE* file = std::fopen(filepath.c_str(), "wb");
+    if (!file)
+    {
+        LOG(Error) << "Failed to open file " << filepath << ". Is it open in another application?";
+        return;
+    }
+    Clock clock;
+    // snapshot the store and release the lock right away so acquisition carries on
+    std::string header = "Time [s],Sense [V],Command [V],Midori [V],Encoder [counts],Enable,";
+    std::vector<std::vector<double>> snapshot;
+    int N;
+    {
+        std::lock_guard<std::mutex> lock(m_data_mtx);
+        N = m_store.size();
+        int columns = SignalStore::Channel0 + m_store.channels();
+        snapshot.resize(columns);
+        for (int c = 0; c < columns; ++c) {
+            // columns of channels that were never plotted are all NaN (written as 0)
+            if (c < SignalStore::Channel0 || m_store.has_channel(c - SignalStore::Channel0)) {
+                snapshot[c].resize(N);
+                m_store.copy(c, snapshot[c].data());
+            }
+            else {
+                snapshot[c].assign(N, std::numeric_limits<double>::quiet_NaN());
+            }
+        }
+        for (int id = 0; id < m_store.channels(); ++id)
+            header += channel_label(id) + ",";
+    }
+    header += "\n";
+    double snap_ms = clock.get_elapsed_time().as_milliseconds();
+    // format in parallel and write in large blocks
+    std::vector<const double*> columns;
+    for (auto& column : snapshot)
+        columns.push_back(column.data());
+    std::fwrite(header.data(), 1, header.size(), file);
+    bool ok = csv_write(file, columns, N);
+    ok &= std::fclose(file) == 0;
+    if (ok)
+        LOG(Info) << "Exported " << N << " samples to " << filepath << " in " << clock.get_elapsed_time().as_milliseconds() << " ms (" << snap_ms << " ms snapshot).";
+    else
+        LOG(Error) << "Failed to write " << filepath << ". Is the disk full?";
+}
+
+void Rig::start_recording(const std::string& filepath) {
+    Handshake link = hello();
+    RecordingHeader header;
+    header.loop_rate  = link.loop_rate;
+    header.decimation = link.decimation;
+    header.start      = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!m_recorder.start(filepath, header))
+        return;
+    std::vector<std::string> labels;
+    {
+        std::lock_guard<std::mutex> lock(m_data_mtx);
+        labels = m_channels;
+    }
+    m_recorder.write_labels(0, labels);
+}
+
+
+std::string Rig::channel_label(int id) const {
+    if (id < (int)m_channels.size())
+        return m_channels[id];
+    return fmt::format("Channel {}", id);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <Mahi/Com.hpp>
+#include "common.hpp"         // for Message, Status, Handshake, LogBuffer
+#include "Frame.hpp"          // for FRAME_HEADER_BYTES, FRAME_STATE_BYTES
+#include "SampleQueue.hpp"    // for SampleQueue
+#include "SignalStore.hpp"    // for SignalStore
+#include "Recorder.hpp"       // for Recorder
+#include "ReorderBuffer.hpp"  // for ReorderStats
+#include "ShmRing.hpp"        // for ShmRing
+#include <atomic>             // for std::atomic_bool
+#include <cstdint>            // for std::int64_t
+#include <mutex>              // for std::mutex
+#include <string>             // for std::string
+#include <thread>             // for std::thread
+#include <vector>             // for std::vector
+
+/// The most plot channels kept per sample: as many as fit in one MAX_FRAME_BYTES frame.
+#define GUI_MAX_CHANNELS ((MAX_FRAME_BYTES - FRAME_HEADER_BYTES - FRAME_STATE_BYTES) / 8)
+/// Telemetry samples held back to put reordered samples in order.
+#define REORDER_WINDOW 1024
+/// Seconds a gap in the telemetry is waited on before it counts as lost.
+#define REORDER_HOLD 0.05
+
+/// Telemetry statistics of a rig, kept by its data thread.
+struct NetworkStats {
+    std::int64_t frames  = 0;  ///< valid frames received
+    std::int64_t invalid = 0;  ///< frames discarded as corrupt, truncated or of another protocol
+    std::int64_t dropped = 0;  ///< samples in order but dropped because the UI fell behind
+    ReorderStats samples;      ///< samples received, lost, late, duplicated and reordered on the link
+    double jitter_p50 = 0;     ///< median frame inter-arrival jitter over the last second [ms]
+    double jitter_p99 = 0;     ///< 99th percentile frame inter-arrival jitter over the last second [ms]
+    double jitter_max = 0;     ///< largest frame inter-arrival jitter over the last second [ms]
+};
+
+/// One pendulum controller monitored by the GUI: its control channel,
+/// telemetry stream, history and recorder. Every rig has its own I/O and data
+/// threads and buffers, so the GUI can watch several rigs at once.
+class Rig {
+public:
+    /// Constructor. Telemetry is received on any free UDP port, which the rig is told when connecting,
+    /// or with shm from the rig's shared memory if it runs on this host with --shm.
+    Rig(const std::string& address, unsigned short port, bool shm = false);
+    /// Destructor. Disconnects and joins the rig's threads, which can take a second while connecting.
+    ~Rig();
+
+    /// Connects and handshakes in the background. Returns false if already connecting.
+    bool connect();
+    /// Queues a command for the I/O thread. Returns false if not connected.
+    bool send_message(Message msg);
+    /// Copies the latest Status and remote logs from the I/O thread and moves
+    /// received samples into the store (unless paused). Call once per frame.
+    void update();
+    /// Removes every sample from the store.
+    void clear_data();
+    /// Resizes the store to hold seconds of history at the rig's stream rate.
+    void set_history(int seconds);
+    /// Writes the store to a CSV file.
+    void export_data(const std::string& filepath);
+    /// Starts recording every received frame to a file.
+    void start_recording(const std::string& filepath);
+    /// Returns the label of a plot channel. Call with data_mutex() locked.
+    std::string channel_label(int id) const;
+
+    /// The rig's address and TCP port, e.g. "172.22.11.2:55001".
+    std::string name() const { return m_address + ":" + std::to_string(m_port); }
+    /// The rig's TCP port.
+    unsigned short port() const { return m_port; }
+    bool connected() const { return m_connected; }
+    bool connecting() const { return m_connecting; }
+    /// The latest Status, as of the last update().
+    const Status& status() const { return m_status; }
+    /// The handshake received when connecting.
+    Handshake hello() const;
+    /// Seconds of history kept in the store.
+    int history() const { return m_history; }
+    bool paused() const { return m_paused; }
+    void set_paused(bool paused) { m_paused = paused; }
+    /// Logs received from the rig.
+    LogBuffer& logs() { return m_logs; }
+    /// Guards store() and the channel labels.
+    std::mutex& data_mutex() { return m_data_mtx; }
+    const SignalStore& store() const { return m_store; }
+    Recorder& recorder() { return m_recorder; }
+
+    unsigned short tcp_local_port() const { return m_tcp.get_local_port(); }
+    unsigned short udp_local_port() const { return m_udp.get_local_port(); }
+    unsigned short udp_remote_port() const { return m_udp_remote; }
+    /// Is telemetry being read from shared memory instead of UDP?
+    bool via_shm() const { return m_via_shm; }
+    int messages_sent() const { return m_msgSent; }
+    /// Returns a copy of the telemetry statistics of the current connection.
+    NetworkStats network_stats() const;
+
+private:
+    bool handshake();
+    bool send_packet(Packet& packet);
+    void io_thread_func();
+    void data_thread_func();
+private:
+    const std::string     m_address;
+    const unsigned short  m_port;
+    TcpSocket             m_tcp;
+    UdpSocket             m_udp;
+    std::atomic_bool      m_connected;
+    std::atomic_bool      m_connecting;
+    std::mutex            m_data_mtx;
+    Status                m_status;
+    std::thread           m_io_thread;
+    std::thread           m_data_thread;
+    std::atomic<int>      m_msgSent;
+    mutable std::mutex    m_stats_mtx;       // guards m_stats, shared with the data thread
+    NetworkStats          m_stats;
+    std::atomic<unsigned short> m_udp_remote;
+    const bool            m_shm;             // read telemetry from shared memory if the rig is on this host?
+    ShmRing               m_ring;            // the rig's telemetry ring (opened by the I/O thread, read by the data thread)
+    std::atomic_bool      m_via_shm;         // m_ring is open for the current connection
+    Handshake             m_hello;           // written by the I/O thread (guarded by m_io_mtx)
+    LogBuffer             m_logs;
+private:
+    SampleQueue     m_queue;
+    SignalStore     m_store;             // every plotted signal, sized by m_history
+    std::atomic_int m_history{60};       // seconds of history kept in m_store
+    bool            m_paused  = false;   // stop adding samples to m_store?
+    std::vector<std::string> m_channels; // user plot labels indexed by channel ID
+    Recorder        m_recorder;          // records every received frame to disk
+private:
+    mutable std::mutex   m_io_mtx;       // guards m_hello and the members below, shared with the I/O thread
+    std::vector<Message> m_requests;     // commands waiting for the I/O thread to send
+    Status               m_io_status;    // the latest Status received by the I/O thread
+    std::vector<std::pair<Severity, std::string>> m_io_logs; // remote logs not yet shown
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "common.hpp"  // for State
+#include <algorithm>   // for std::fill, std::copy
+#include <cmath>       // for std::isnan, std::fmin, std::fmax
+#include <cstdint>     // for std::uint64_t
+#include <limits>      // for std::numeric_limits
+#include <memory>      // for std::unique_ptr
+#include <vector>      // for std::vector
+
+/// The number of samples per bucket grows by 2^LOD_SHIFT with each level of detail.
+#define LOD_SHIFT 2
+
+/// Columnar ring buffer of every signal the GUI plots. All columns share one
+/// write position and the Time column, so row n of every column is the same
+/// sample. Plot channel columns are indexed by channel ID and allocated the
+/// first time a channel is plotted; rows where a channel wasn't plotted are NaN.
+///
+/// Each column also keeps a min/max pyramid, updated as samples arrive: level k
+/// holds the min and max of every 4^k samples, so a plot can draw any span of
+/// history with a few points per pixel (see span and point).
+class SignalStore {
+public:
+    /// Columns of the controller state. Plot channel i is column Channel0 + i.
+    enum Column {
+        Time     = 0,
+        Sense    = 1,
+        Command  = 2,
+        Midori   = 3,
+        Encoder  = 4,
+        Enable   = 5,
+        Channel0 = 6
+    };
+
+    /// Points of one column to draw at one level of detail.
+    struct Span {
+        int           column; ///< the column drawn
+        int           level;  ///< 0 for raw samples, otherwise the pyramid level
+        std::uint64_t first;  ///< the first sample (level 0) or bucket drawn
+        int           count;  ///< the number of points to draw
+    };
+
+    /// Constructor. The capacity is rounded up to a power of two.
+    SignalStore(std::size_t capacity = 1 << 15) { set_capacity(capacity); }
+
+    /// Reallocates every column to hold at least capacity samples. Clears the store.
+    void set_capacity(std::size_t capacity) {
+        std::size_t pow2 = 1;
+        while (pow2 < capacity)
+            pow2 <<= 1;
+        m_mask = pow2 - 1;
+        // stop the pyramid once a level holds fewer than 16 buckets
+        m_offsets.assign(1, 0);
+        for (int k = 1; (pow2 >> (LOD_SHIFT * k)) >= 16; ++k)
+            m_offsets.push_back(m_offsets.back() + 2 * (pow2 >> (LOD_SHIFT * k)));
+        m_columns.clear();
+        for (int c = 0; c < Channel0; ++c)
+            add_column(c);
+        m_head = 0;
+    }
+
+    /// Removes every sample and plot channel.
+    void clear() {
+        m_columns.resize(Channel0);
+        m_head = 0;
+    }
+
+    /// Appends a sample, overwriting the oldest once the store is full.
+    void push(const State& state, const double* values, int count) {
+        std::size_t row = (std::size_t)(m_head & m_mask);
+        m_columns[Time].data[row]    = state.time;
+        m_columns[Sense].data[row]   = state.sense;
+        m_columns[Command].data[row] = state.command;
+        m_columns[Midori].data[row]  = state.midori;
+        m_columns[Encoder].data[row] = state.encoder;
+        m_columns[Enable].data[row]  = state.enable;
+        for (int i = 0; i < count; ++i) {
+            if (!has_channel(i)) {
+                if (std::isnan(values[i]))
+                    continue;
+                add_column(Channel0 + i);
+            }
+            m_columns[Channel0 + i].data[row] = values[i];
+        }
+        // channels this sample doesn't carry weren't plotted
+        for (int i = count; i < channels(); ++i) {
+            if (has_channel(i))
+                m_columns[Channel0 + i].data[row] = std::numeric_limits<double>::quiet_NaN();
+        }
+        for (auto& column : m_columns) {
+            if (column.data)
+                update_pyramid(column, column.data[row]);
+        }
+        m_head++;
+    }
+
+    /// The number of samples held.
+    int size() const { return (int)(m_head < capacity() ? m_head : capacity()); }
+    /// The maximum number of samples held.
+    std::size_t capacity() const { return m_mask + 1; }
+    /// The number of plot channel IDs with a column slot (allocated or not).
+    int channels() const { return (int)m_columns.size() - Channel0; }
+    /// Has plot channel id been plotted since the store was cleared?
+    bool has_channel(int id) const { return id < channels() && m_columns[Channel0 + id].data != nullptr; }
+    /// The number of pyramid levels above the raw samples.
+    int levels() const { return (int)m_offsets.size() - 1; }
+
+    /// Returns the n-th oldest value of a column (NaN for unplotted channel rows).
+    double at(int column, int n) const {
+        return m_columns[column].data[(std::size_t)((m_head - size() + n) & m_mask)];
+    }
+
+    /// Copies every sample of a column, oldest first, into out (size() values).
+    void copy(int column, double* out) const {
+        std::size_t first = (std::size_t)((m_head - size()) & m_mask);
+        std::size_t n1    = std::min((std::size_t)size(), capacity() - first);
+        std::copy(&m_columns[column].data[first], &m_columns[column].data[first] + n1, out);
+        std::copy(&m_columns[column].data[0], &m_columns[column].data[0] + (size() - n1), out + n1);
+    }
+
+    /// Returns the time of the newest sample, or 0 if the store is empty.
+    double latest_time() const {
+        return m_head ? m_columns[Time].data[(std::size_t)((m_head - 1) & m_mask)] : 0;
+    }
+
+    /// Selects the points of column to draw between times t0 and t1, using the
+    /// coarsest level that still gives at least one min/max pair per pixel.
+    Span span(int column, double t0, double t1, int pixels) const {
+        Span s{column, 0, 0, 0};
+        int N = size();
+        if (N == 0)
+            return s;
+        // visible samples, plus one either side so lines run off the edges
+        int n0 = std::max(lower_bound(t0) - 1, 0);
+        int n1 = std::min(lower_bound(t1) + 1, N);
+        std::uint64_t oldest = m_head - N;
+        int k = 0;
+        while (k < levels() && ((std::uint64_t)(n1 - n0) >> (LOD_SHIFT * (k + 1))) >= (std::uint64_t)std::max(pixels, 1))
+            k++;
+        if (k == 0) {
+            s.first = oldest + n0;
+            s.count = n1 - n0;
+            return s;
+        }
+        // whole buckets only at the old end (the oldest may be partly overwritten)
+        int shift = LOD_SHIFT * k;
+        std::uint64_t b0 = (oldest + n0 + (1ull << shift) - 1) >> shift;
+        std::uint64_t b1 = (oldest + n1 - 1) >> shift;
+        s.level = k;
+        s.first = b0;
+        s.count = b1 >= b0 ? 2 * (int)(b1 - b0 + 1) : 0;
+        return s;
+    }
+
+    /// Returns point idx of a span: raw samples at level 0, otherwise alternating bucket min and max.
+    void point(const Span& s, int idx, double& t, double& v) const {
+        const Series& column = m_columns[s.column];
+        if (s.level == 0) {
+            std::size_t row = (std::size_t)((s.first + idx) & m_mask);
+            t = m_columns[Time].data[row];
+            v = column.data[row];
+            return;
+        }
+        int shift = LOD_SHIFT * s.level;
+        std::uint64_t bucket = s.first + idx / 2;
+        t = m_columns[Time].data[(std::size_t)((bucket << shift) & m_mask)];
+        v = column.pyramid[m_offsets[s.level - 1] + 2 * (std::size_t)(bucket & (m_mask >> shift)) + idx % 2];
+    }
+
+private:
+    /// A column's samples and its min/max pyramid.
+    struct Series {
+        std::unique_ptr<double[]> data;    // samples
+        std::unique_ptr<double[]> pyramid; // min and max of each bucket, level by level
+    };
+
+    /// Allocates column c, with every existing row unplotted.
+    void add_column(int c) {
+        if (c >= (int)m_columns.size())
+            m_columns.resize(c + 1);
+        Series& column = m_columns[c];
+        column.data.reset(new double[capacity()]);
+        column.pyramid.reset(new double[std::max<std::size_t>(m_offsets.back(), 1)]);
+        std::fill(column.data.get(), column.data.get() + capacity(), std::numeric_limits<double>::quiet_NaN());
+        std::fill(column.pyramid.get(), column.pyramid.get() + m_offsets.back(), std::numeric_limits<double>::quiet_NaN());
+    }
+
+    /// Folds the value of sample m_head into every level of a column's pyramid.
+    void update_pyramid(Series& column, double v) {
+        for (int k = 1; k <= levels(); ++k) {
+            int shift = LOD_SHIFT * k;
+            double* bucket = &column.pyramid[m_offsets[k - 1] + 2 * (std::size_t)((m_head >> shift) & (m_mask >> shift))];
+            if ((m_head & ((1ull << shift) - 1)) == 0) {
+                bucket[0] = v;
+                bucket[1] = v;
+            }
+            else {
+                // fmin/fmax ignore NaN, so unplotted rows don't hide the rest of the bucket
+                bucket[0] = std::fmin(bucket[0], v);
+                bucket[1] = std::fmax(bucket[1], v);
+            }
+        }
+    }
+
+    /// Returns the first sample n with time >= t (times increase with n).
+    int lower_bound(double t) const {
+        int lo = 0, hi = size();
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (at(Time, mid) < t)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    std::vector<Series>      m_columns; // columns (no data for unplotted channels)
+    std::vector<std::size_t> m_offsets; // start of level k+1 in each pyramid; back() is its size
+    std::uint64_t            m_head;    // total number of samples pushed
+    std::uint64_t            m_mask;    // capacity - 1
+};
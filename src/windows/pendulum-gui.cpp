@@ -1,9 +1,20 @@
 #define MAHI_GUI_NO_CONSOLE
 #include "PendulumGui.hpp"
+#include <cstring>  // for std::strcmp
 
 int main(int argc, char const *argv[])
 {
-    PendulumGui gui;
+    // monitor every rig given as address[:port], e.g. several simulated pendulums,
+    // with --shm reading those on this host from shared memory
+    std::vector<std::string> rigs;
+    bool shm = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--shm"))
+            shm = true;
+        else
+            rigs.push_back(argv[i]);
+    }
+    PendulumGui gui(rigs, shm);
     gui.run();
     return 0;
 }